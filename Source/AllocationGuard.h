@@ -0,0 +1,69 @@
+/*
+  ==============================================================================
+
+    AllocationGuard.h
+    Debug hook that reports heap allocations made on the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// Set this to 1 in a test/debug build to replace the global operator new
+// (including the aligned overloads) and count the allocations made inside
+// processBlock() or processBlockBypassed(). The test project enables it.
+#ifndef HEURISTICLIMITER_ALLOCATION_GUARD
+ #define HEURISTICLIMITER_ALLOCATION_GUARD 0
+#endif
+
+namespace dsp_original
+{
+
+        /**
+            Counts heap allocations made while an audio callback is running.
+
+            The counting only happens when HEURISTICLIMITER_ALLOCATION_GUARD is enabled,
+            because it needs the replacement operator new in PluginProcessor.cpp.
+
+            The hook only counts: asserting from inside operator new would allocate
+            again while logging and recurse. Tests check getNumAudioThreadAllocations().
+
+            Only operator new/new[] is hooked. std::malloc() and friends are not,
+            so a juce::HeapBlock or juce::AudioBuffer that (re)allocates on the
+            audio thread goes unnoticed; those are sized in prepareToPlay() and
+            must stay that way. Allocations from scheduler worker threads are not
+            tracked either.
+        */
+        struct AllocationGuard
+        {
+            /** Marks the current thread as being inside an audio callback. */
+            class ScopedAudioCallback
+            {
+            public:
+                ScopedAudioCallback() noexcept { ++depth; }
+                ~ScopedAudioCallback() noexcept { --depth; }
+
+                JUCE_DECLARE_NON_COPYABLE(ScopedAudioCallback)
+            };
+
+            /** Called by the replacement operator new. */
+            static void allocationMade() noexcept
+            {
+                if (depth > 0)
+                    numAudioThreadAllocations.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            static int getNumAudioThreadAllocations() noexcept
+            {
+                return numAudioThreadAllocations.load(std::memory_order_relaxed);
+            }
+
+        private:
+            static inline thread_local int depth = 0;
+            static inline std::atomic<int> numAudioThreadAllocations { 0 };
+        };
+
+} // namespace dsp_original
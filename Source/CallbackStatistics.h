@@ -0,0 +1,125 @@
+/*
+  ==============================================================================
+
+    CallbackStatistics.h
+    Timing and output sanity statistics of the audio callback.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+namespace dsp_original
+{
+
+        /**
+            Records how long each audio callback took compared to the audio it
+            produced, and counts non-finite and over-full-scale output samples.
+
+            A callback misses its deadline when it takes longer than the duration of
+            its block, which is what a realtime host allows at most. The results are
+            published through atomics and may be read from any thread, for example to
+            qualify a build by playing it under varying block sizes and automation.
+        */
+        class CallbackStatistics
+        {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+            CallbackStatistics() = default;
+
+            /** Clears everything; call from prepareToPlay(). */
+            void reset() noexcept
+            {
+                numCallbacks.store(0);
+                numDeadlineMisses.store(0);
+                numNonFiniteSamples.store(0);
+                numOvers.store(0);
+                worstCallbackTime.store(0.0);
+                worstLoad.store(0.0);
+            }
+
+            /** Asks the audio thread to clear the statistics; may be called from any thread. */
+            void resetStatistics() noexcept
+            {
+                resetRequested.store(true);
+            }
+
+            //==============================================================================
+            /** Call at the end of a callback with the time it started and its final output.
+                Pass countOvers = false for a bypassed callback, whose overs are the input's.
+            */
+            template <typename SampleType>
+            void callbackFinished(Clock::time_point callbackStart, double sampleRate,
+                                  const juce::dsp::AudioBlock<SampleType>& output, bool countOvers = true) noexcept
+            {
+                const auto elapsed = std::chrono::duration<double>(Clock::now() - callbackStart).count();
+
+                if (resetRequested.exchange(false))
+                    reset();
+
+                auto nonFinite = 0, overs = 0;
+
+                for (size_t channel = 0; channel < output.getNumChannels(); ++channel)
+                {
+                    const auto* samples = output.getChannelPointer(channel);
+
+                    for (size_t i = 0; i < output.getNumSamples(); ++i)
+                    {
+                        if (! std::isfinite(samples[i]))
+                            ++nonFinite;
+                        else if (countOvers && std::abs(samples[i]) > static_cast<SampleType>(1.0))
+                            ++overs;
+                    }
+                }
+
+                const auto blockDuration = static_cast<double>(output.getNumSamples()) / sampleRate;
+                const auto load = blockDuration > 0.0 ? elapsed / blockDuration : 0.0;
+
+                numCallbacks.fetch_add(1, std::memory_order_relaxed);
+
+                if (load > 1.0)
+                    numDeadlineMisses.fetch_add(1, std::memory_order_relaxed);
+
+                if (nonFinite > 0)
+                    numNonFiniteSamples.fetch_add(nonFinite, std::memory_order_relaxed);
+
+                if (overs > 0)
+                    numOvers.fetch_add(overs, std::memory_order_relaxed);
+
+                if (elapsed > worstCallbackTime.load(std::memory_order_relaxed))
+                    worstCallbackTime.store(elapsed, std::memory_order_relaxed);
+
+                if (load > worstLoad.load(std::memory_order_relaxed))
+                    worstLoad.store(load, std::memory_order_relaxed);
+            }
+
+            //==============================================================================
+            int getNumCallbacks() const noexcept       { return numCallbacks.load(std::memory_order_relaxed); }
+            int getNumDeadlineMisses() const noexcept  { return numDeadlineMisses.load(std::memory_order_relaxed); }
+            int getNumNonFiniteSamples() const noexcept { return numNonFiniteSamples.load(std::memory_order_relaxed); }
+
+            /** Returns the number of output samples above 0 dBFS, bypassed callbacks excluded. */
+            int getNumOvers() const noexcept           { return numOvers.load(std::memory_order_relaxed); }
+
+            /** Returns the longest callback in seconds. */
+            double getWorstCallbackTime() const noexcept { return worstCallbackTime.load(std::memory_order_relaxed); }
+
+            /** Returns the largest ratio of callback time to block duration (1 = deadline). */
+            double getWorstLoad() const noexcept       { return worstLoad.load(std::memory_order_relaxed); }
+
+        private:
+            //==============================================================================
+            std::atomic<int> numCallbacks { 0 }, numDeadlineMisses { 0 }, numNonFiniteSamples { 0 }, numOvers { 0 };
+            std::atomic<double> worstCallbackTime { 0.0 }, worstLoad { 0.0 };
+            std::atomic<bool> resetRequested { false };
+
+            JUCE_DECLARE_NON_COPYABLE(CallbackStatistics)
+        };
+
+} // namespace dsp_original
@@ -0,0 +1,200 @@
+/*
+  ==============================================================================
+
+    GainComputer.h
+    Static gain curve of the look-ahead compressor.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cstring>
+#include <limits>
+
+namespace dsp_original
+{
+
+        /** How the gain computer evaluates its curve. */
+        enum class GainCurveType
+        {
+            limiter,    // infinite ratio, hard knee: gain = threshold / env
+            table,      // lookup table with linear interpolation
+            exact       // std::pow per sample, the reference implementation
+        };
+
+        /**
+            Maps the detector envelope to a gain, given threshold, ratio and knee.
+
+            Threshold and ratio change at most once per block, so the curve is baked
+            into a table whenever they change. The table is indexed by the bit pattern
+            of env / threshold as a float: the exponent selects the octave and the top
+            mantissa bits select the step within it. A lookup therefore needs no log,
+            exp or pow. With an infinite ratio and no knee the curve is a single
+            division, which getType() reports as GainCurveType::limiter.
+        */
+        template <typename SampleType>
+        class GainComputer
+        {
+        public:
+            GainComputer()
+            {
+                setParameters(static_cast<SampleType>(0.0), static_cast<SampleType>(1.0), static_cast<SampleType>(0.0));
+            }
+
+            //==============================================================================
+            /** Sets the threshold in dB, the ratio (may be infinite) and the knee width in dB.
+                Rebuilds the table only if something has changed.
+            */
+            void setParameters(SampleType newThresholddB, SampleType newRatio, SampleType newKneedB) noexcept
+            {
+                jassert(newRatio >= static_cast<SampleType>(1.0));
+                jassert(newKneedB >= static_cast<SampleType>(0.0) && newKneedB <= maximumKneedB);
+
+                if (newThresholddB == thresholddB && newRatio == ratio && newKneedB == kneedB && ! tableNeedsUpdate)
+                    return;
+
+                thresholddB = newThresholddB;
+                ratio = newRatio;
+                kneedB = juce::jlimit(static_cast<SampleType>(0.0), maximumKneedB, newKneedB);
+
+                threshold = juce::Decibels::decibelsToGain(thresholddB, static_cast<SampleType>(-200.0));
+                thresholdInverse = static_cast<SampleType>(1.0) / threshold;
+                ratioInverse = static_cast<SampleType>(1.0) / ratio;
+                kneeStart = juce::Decibels::decibelsToGain(-kneedB / static_cast<SampleType>(2.0));
+
+                for (size_t i = 0; i < table.size(); ++i)
+                    table[i] = static_cast<float>(computeExactGain(fromTableIndex(i)));
+
+                tableNeedsUpdate = false;
+            }
+
+            /** Takes over the curve of another gain computer. The table is only copied when
+                threshold, ratio or knee differ, so copying the same settings again, as every
+                search trial does, costs a few scalar assignments.
+            */
+            void copyFrom(const GainComputer& other) noexcept
+            {
+                if (other.thresholddB != thresholddB || other.ratio != ratio || other.kneedB != kneedB || tableNeedsUpdate)
+                    table = other.table;
+
+                thresholddB = other.thresholddB;
+                ratio = other.ratio;
+                kneedB = other.kneedB;
+                threshold = other.threshold;
+                thresholdInverse = other.thresholdInverse;
+                ratioInverse = other.ratioInverse;
+                kneeStart = other.kneeStart;
+                useExactCurve = other.useExactCurve;
+                tableNeedsUpdate = other.tableNeedsUpdate;
+            }
+
+            /** Forces the exact (std::pow) curve, for reference renders. */
+            void setUseExactCurve(bool shouldUseExactCurve) noexcept
+            {
+                useExactCurve = shouldUseExactCurve;
+            }
+
+            GainCurveType getType() const noexcept
+            {
+                if (useExactCurve)
+                    return GainCurveType::exact;
+
+                return (ratioInverse == static_cast<SampleType>(0.0) && kneedB == static_cast<SampleType>(0.0))
+                           ? GainCurveType::limiter : GainCurveType::table;
+            }
+
+            //==============================================================================
+            /** Returns the linear gain for a detector envelope value. */
+            template <GainCurveType curveType, typename EnvelopeType>
+            SampleType getGain(EnvelopeType env) const noexcept
+            {
+                const auto x = static_cast<SampleType>(env * thresholdInverse);
+
+                if constexpr (curveType == GainCurveType::limiter)
+                {
+                    return x < static_cast<SampleType>(1.0) ? static_cast<SampleType>(1.0)
+                                                            : static_cast<SampleType>(1.0) / x;
+                }
+                else if constexpr (curveType == GainCurveType::table)
+                {
+                    if (x < kneeStart)
+                        return static_cast<SampleType>(1.0);
+
+                    auto bits = toBits(static_cast<float>(x));
+
+                    if (bits >= highestBits)
+                        return computeExactGain(x);
+
+                    bits -= lowestBits;
+                    const auto index = bits >> fractionBits;
+                    const auto fraction = static_cast<float>(bits & fractionMask) * (1.0f / static_cast<float>(1u << fractionBits));
+
+                    return static_cast<SampleType>(table[index] + fraction * (table[index + 1] - table[index]));
+                }
+                else
+                {
+                    return computeExactGain(x);
+                }
+            }
+
+        private:
+            //==============================================================================
+            static constexpr SampleType maximumKneedB = static_cast<SampleType>(24.0);
+
+            // the table covers env / threshold from -24 dB (4 octaves, below the -12 dB where the
+            // widest knee starts) to +120 dB (20 octaves); above that the curve is evaluated exactly
+            static constexpr int octavesBelow = 4, octavesAbove = 20, stepsPerOctaveLog2 = 5;
+            static constexpr uint32_t fractionBits = 23 - stepsPerOctaveLog2;
+            static constexpr uint32_t fractionMask = (1u << fractionBits) - 1;
+            static constexpr uint32_t lowestBits = static_cast<uint32_t>(127 - octavesBelow) << 23;
+            static constexpr uint32_t highestBits = static_cast<uint32_t>(127 + octavesAbove) << 23;
+            static constexpr size_t tableSize = ((octavesBelow + octavesAbove) << stepsPerOctaveLog2) + 1;
+
+            static uint32_t toBits(float value) noexcept
+            {
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                return bits;
+            }
+
+            static SampleType fromTableIndex(size_t index) noexcept
+            {
+                const auto bits = lowestBits + (static_cast<uint32_t>(index) << fractionBits);
+                float value;
+                std::memcpy(&value, &bits, sizeof(value));
+                return static_cast<SampleType>(value);
+            }
+
+            /** x is env / threshold. */
+            SampleType computeExactGain(SampleType x) const noexcept
+            {
+                if (kneedB == static_cast<SampleType>(0.0))
+                    return (x < static_cast<SampleType>(1.0)) ? static_cast<SampleType>(1.0)
+                        : std::pow(x, ratioInverse - static_cast<SampleType>(1.0));
+
+                // soft knee, evaluated in the dB domain
+                const auto overshootdB = juce::Decibels::gainToDecibels(x, static_cast<SampleType>(-200.0));
+                const auto halfKnee = kneedB / static_cast<SampleType>(2.0);
+                const auto slope = ratioInverse - static_cast<SampleType>(1.0);
+
+                if (overshootdB <= -halfKnee)
+                    return static_cast<SampleType>(1.0);
+
+                const auto gaindB = overshootdB < halfKnee
+                    ? slope * juce::square(overshootdB + halfKnee) / (static_cast<SampleType>(2.0) * kneedB)
+                    : slope * overshootdB;
+
+                return juce::Decibels::decibelsToGain(gaindB, static_cast<SampleType>(-200.0));
+            }
+
+            //==============================================================================
+            std::array<float, tableSize> table {};
+            SampleType thresholddB = 0, ratio = 1, kneedB = 0;
+            SampleType threshold = 1, thresholdInverse = 1, ratioInverse = 1, kneeStart = 1;
+            bool useExactCurve = false, tableNeedsUpdate = true;
+        };
+
+} // namespace dsp_original
@@ -0,0 +1,373 @@
+/*
+  ==============================================================================
+
+    HeuristicSimulator.h
+    Base-rate trial runs of the limiter for the attack/release search.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "LookForwardingCompressor.h"
+#include "ScratchArena.h"
+#include "SlidingSpectrum.h"
+
+namespace dsp_original
+{
+
+        /**
+            Runs candidate attack or release times on a copy of the production
+            compressor and scores the output against the spectrum of the key.
+
+            The reference is the key delayed by the look-ahead, tracked over a frame
+            of about 10 ms by a SlidingSpectrum. A trial runs in at least four hops of
+            a quarter frame to a frame, the last one ending with the block, and sums
+            the distances of the frames ending at each hop. Earlier blocks' output
+            fills the first frames.
+
+            Trials run at the host rate with the production times and always see the
+            full look-ahead, which is the alignment of the oversampled output.
+        */
+        template <typename ShaperFunction>
+        class HeuristicSimulator
+        {
+        public:
+            using Compressor = LookAheadCompressor<float>;
+            static constexpr int maxChannels = 2;
+            static constexpr double analysisFrameTime = 10.0;
+            static constexpr int numAnalysisBins = 32;
+            static constexpr int minimumNumHops = 4;
+
+            enum class Parameter
+            {
+                attack,
+                release
+            };
+
+            HeuristicSimulator() = default;
+
+            //==============================================================================
+            /** Passed on to the simulated compressor, see LookAheadCompressor. */
+            void setMaximumLookAheadTime(float newMaximumLookAheadTime)
+            {
+                maximumLookAheadTime = newMaximumLookAheadTime;
+                compressor.setMaximumLookAheadTime(newMaximumLookAheadTime);
+            }
+
+            void setLookAheadTime(float newLookAheadTime) { compressor.setLookAheadTime(newLookAheadTime); }
+
+            /** Whether trials go through the soft clip. Turn this off for a band of a multiband
+                split, where the clip only follows the sum of the bands.
+            */
+            void setShaperEnabled(bool shouldUseShaper) noexcept { shaperEnabled = shouldUseShaper; }
+
+            /** Uses only every n-th analysis bin for the distance, for a cheaper, coarser measure. */
+            void setAnalysisBinStride(int newStride) noexcept { binStride = juce::jmax(1, newStride); }
+
+            /** Returns the scratch memory prepare() takes from the arena. */
+            static size_t getRequiredScratchBytes(double sampleRate, int maximumBlockSize) noexcept
+            {
+                const auto workspaceSize = static_cast<size_t>(2 * SlidingSpectrum::getFrameSizeFor(sampleRate, analysisFrameTime));
+
+                return maxChannels * (ScratchArena::getRequiredBytes<float>(workspaceSize)
+                                      + ScratchArena::getRequiredBytes<float>(static_cast<size_t>(maximumBlockSize)));
+            }
+
+            /** Prepares the simulation with the spec of the production compressor. The scratch
+                buffers are carved from the arena, which must have room for getRequiredScratchBytes().
+            */
+            void prepare(const juce::dsp::ProcessSpec& spec, ScratchArena& arena)
+            {
+                jassert(spec.numChannels <= static_cast<juce::uint32>(maxChannels));
+
+                compressor.prepare(spec);
+
+                const auto frameSize = SlidingSpectrum::getFrameSizeFor(spec.sampleRate, analysisFrameTime);
+                referenceSpectrum.prepare(spec.sampleRate, frameSize, numAnalysisBins, static_cast<int>(spec.numChannels));
+
+                const auto referenceDelaySize = static_cast<size_t>(spec.sampleRate * maximumLookAheadTime / 1000.0) + 1;
+
+                for (size_t channel = 0; channel < maxChannels; ++channel)
+                {
+                    referenceDelay[channel].assign(referenceDelaySize, 0.0f);
+                    outputHistory[channel].assign(static_cast<size_t>(frameSize), 0.0f);
+
+                    workspace[channel] = arena.allocate<float>(static_cast<size_t>(2 * frameSize));
+                    output[channel] = arena.allocate<float>(spec.maximumBlockSize);
+                }
+
+                minimumHopSize = static_cast<size_t>(juce::jmax(1, frameSize / minimumNumHops));
+                const auto maximumNumHops = juce::jmax(size_t { 1 }, (static_cast<size_t>(spec.maximumBlockSize) + minimumHopSize - 1) / minimumHopSize);
+                referenceMagnitudes.assign(maximumNumHops * maxChannels * SlidingSpectrum::maxBins, 0.0f);
+
+                reset();
+            }
+
+            /** Clears the reference spectrum, the output history and the trial counter. */
+            void reset() noexcept
+            {
+                referenceSpectrum.reset();
+                referenceDelayPosition = 0;
+                numAbandonedTrials = 0;
+
+                for (size_t channel = 0; channel < maxChannels; ++channel)
+                {
+                    std::fill(referenceDelay[channel].begin(), referenceDelay[channel].end(), 0.0f);
+                    std::fill(outputHistory[channel].begin(), outputHistory[channel].end(), 0.0f);
+                }
+
+                std::fill(referenceMagnitudes.begin(), referenceMagnitudes.end(), 0.0f);
+            }
+
+            //==============================================================================
+            /** Takes the current block and keeps the reference magnitudes at the end of every
+                hop. The key drives the detector of the trials; it is the input itself unless
+                the production compressor follows a sidechain. A key with more channels than
+                the input is measured as their mean.
+            */
+            void beginBlock(const Compressor& productionCompressor,
+                            const juce::dsp::AudioBlock<const float>& inputBlock,
+                            const juce::dsp::AudioBlock<const float>& keyBlock) noexcept
+            {
+                production = &productionCompressor;
+                input = inputBlock;
+                key = keyBlock;
+
+                const auto numSamples = input.getNumSamples();
+                const auto frameSize = outputHistory.front().size();
+                const auto hopsPerBlock = static_cast<size_t>(minimumNumHops);
+                hopSize = juce::jlimit(minimumHopSize, frameSize, (numSamples + hopsPerBlock - 1) / hopsPerBlock);
+                numHops = juce::jlimit(size_t { 1 }, referenceMagnitudes.size() / (maxChannels * SlidingSpectrum::maxBins), (numSamples + hopSize - 1) / hopSize);
+
+                const auto referenceDelaySize = referenceDelay.front().size();
+                const auto numSamplesLookAhead = juce::jmin(static_cast<size_t>(productionCompressor.getLatencyInSamples()), referenceDelaySize - 1);
+
+                for (size_t channel = 0; channel < getNumChannels(); ++channel)
+                {
+                    auto* delay = referenceDelay[channel].data();
+                    auto position = referenceDelayPosition;
+
+                    for (size_t hop = 0, i = 0; hop < numHops; ++hop)
+                    {
+                        for (const auto end = getHopEnd(hop); i < end; ++i)
+                        {
+                            delay[position] = getKeySample(channel, i);
+                            referenceSpectrum.pushSample(static_cast<int>(channel), delay[(position + referenceDelaySize - numSamplesLookAhead) % referenceDelaySize]);
+                            position = (position + 1) % referenceDelaySize;
+                        }
+
+                        referenceSpectrum.getMagnitudes(static_cast<int>(channel), getReferenceMagnitudes(hop, channel));
+                    }
+                }
+
+                referenceDelayPosition = (referenceDelayPosition + numSamples) % referenceDelaySize;
+            }
+
+            /** Runs one trial with the given time in milliseconds and returns its distance
+                to the reference spectrum.
+
+                If the distance exceeds the bound before the end of the block, the trial
+                stops and returns the distance so far. Like the full cost it is above the
+                bound, so Brent's method compares it with its best point the same way and
+                the best point is always fully evaluated. Only the parabolic fit sees a
+                lower value.
+            */
+            template <Parameter parameter>
+            double evaluate(double timeInMilliseconds, double bound = std::numeric_limits<double>::infinity()) noexcept
+            {
+                jassert(production != nullptr);
+
+                // start from the current state of the production compressor (no allocation)
+                compressor.copyStateFrom(*production);
+
+                if constexpr (parameter == Parameter::release)
+                    compressor.setRelease(static_cast<float>(timeInMilliseconds));
+                else
+                    compressor.setAttack(static_cast<float>(timeInMilliseconds));
+
+                auto cost = 0.0;
+
+                for (size_t hop = 0; hop < numHops; ++hop)
+                {
+                    runTrial(hop == 0 ? 0 : getHopEnd(hop - 1), getHopEnd(hop));
+                    cost += measureHop(hop);
+
+                    // already worse than the best so far: no need to finish the block
+                    if (cost > bound && hop + 1 < numHops)
+                    {
+                        ++numAbandonedTrials;
+                        return cost;
+                    }
+                }
+
+                return cost;
+            }
+
+            /** Runs the parameters the production compressor ended up with, and keeps the
+                end of the result as the history the next block's trials continue from.
+                Call this after the search, before the production compressor processes the block.
+            */
+            void endBlock() noexcept
+            {
+                jassert(production != nullptr);
+
+                compressor.copyStateFrom(*production);
+                runTrial(0, input.getNumSamples());
+
+                const auto numSamples = input.getNumSamples();
+                const auto frameSize = outputHistory.front().size();
+                const auto numNew = juce::jmin(numSamples, frameSize);
+
+                for (size_t channel = 0; channel < getNumChannels(); ++channel)
+                {
+                    auto& history = outputHistory[channel];
+                    const auto* trialOutput = output[channel] + (numSamples - numNew);
+
+                    std::copy(history.begin() + static_cast<std::ptrdiff_t>(numNew), history.end(), history.begin());
+
+                    for (size_t i = 0; i < numNew; ++i)
+                        history[frameSize - numNew + i] = shape(trialOutput[i]);
+                }
+            }
+
+            /** Returns a callable for the minimiser. It passes the best cost it has returned
+                so far as the bound, so use a new one for every search.
+            */
+            template <Parameter parameter>
+            auto getObjective() noexcept
+            {
+                return [this, bound = std::numeric_limits<double>::infinity()](double timeInMilliseconds) mutable {
+                    const auto cost = evaluate<parameter>(timeInMilliseconds, bound);
+                    bound = juce::jmin(bound, cost);
+                    return cost;
+                };
+            }
+
+            /** Returns the number of trials stopped early since the last reset(). */
+            int getNumAbandonedTrials() const noexcept { return numAbandonedTrials; }
+
+            size_t getMemoryUsageInBytes() const noexcept
+            {
+                return compressor.getMemoryUsageInBytes()
+                     + referenceSpectrum.getMemoryUsageInBytes()
+                     + (maxChannels * (referenceDelay.front().size() + outputHistory.front().size()) + referenceMagnitudes.size()) * sizeof(float);
+            }
+
+        private:
+            //==============================================================================
+            size_t getNumChannels() const noexcept
+            {
+                return juce::jmin(input.getNumChannels(), static_cast<size_t>(maxChannels));
+            }
+
+            float shape(float x) const noexcept
+            {
+                return shaperEnabled ? shaper(x) : x;
+            }
+
+            float getKeySample(size_t channel, size_t i) const noexcept
+            {
+                const auto numKeyChannels = key.getNumChannels();
+
+                if (channel + 1 < getNumChannels() || numKeyChannels <= channel + 1)
+                    return key.getChannelPointer(juce::jmin(channel, numKeyChannels - 1))[i];
+
+                auto sum = 0.0f;
+                for (auto keyChannel = channel; keyChannel < numKeyChannels; ++keyChannel)
+                    sum += key.getChannelPointer(keyChannel)[i];
+
+                return sum / static_cast<float>(numKeyChannels - channel);
+            }
+
+            /** Returns the end of a hop; the last one ends with the block. */
+            size_t getHopEnd(size_t hop) const noexcept
+            {
+                const auto numSamples = input.getNumSamples();
+                return numSamples - juce::jmin(numSamples, (numHops - 1 - hop) * hopSize);
+            }
+
+            float* getReferenceMagnitudes(size_t hop, size_t channel) noexcept
+            {
+                return referenceMagnitudes.data() + (hop * maxChannels + channel) * SlidingSpectrum::maxBins;
+            }
+
+            const float* getReferenceMagnitudes(size_t hop, size_t channel) const noexcept
+            {
+                return referenceMagnitudes.data() + (hop * maxChannels + channel) * SlidingSpectrum::maxBins;
+            }
+
+            void runTrial(size_t startSample, size_t endSample) noexcept
+            {
+                juce::dsp::AudioBlock<float> outputBlock(output.data(), getNumChannels(), input.getNumSamples());
+                auto outputSegment = outputBlock.getSubBlock(startSample, endSample - startSample);
+                compressor.process(juce::dsp::ProcessContextNonReplacing<float>(input.getSubBlock(startSample, endSample - startSample), outputSegment),
+                                   key.getSubBlock(startSample, endSample - startSample));
+            }
+
+            /** Sums the distances of all channels for the frame ending with a hop. */
+            double measureHop(size_t hop) noexcept
+            {
+                auto result = 0.0;
+
+                for (size_t channel = 0; channel < getNumChannels(); ++channel)
+                    result += computeSpectralDistance(channel, hop);
+
+                return result;
+            }
+
+            double computeSpectralDistance(size_t channel, size_t hop) const noexcept
+            {
+                const auto& history = outputHistory[channel];
+                const auto frameSize = history.size();
+                const auto end = getHopEnd(hop);
+                const auto numNew = juce::jmin(end, frameSize);
+                const auto* trialOutput = output[channel] + (end - numNew);
+                auto* frame = workspace[channel];
+
+                // the frame ending with this hop: earlier output if needed, then the soft-clipped trial
+                std::copy(history.begin() + static_cast<std::ptrdiff_t>(numNew), history.end(), frame);
+
+                for (size_t i = 0; i < numNew; ++i)
+                    frame[frameSize - numNew + i] = shape(trialOutput[i]);
+
+                std::array<float, SlidingSpectrum::maxBins> candidate;
+                referenceSpectrum.computeFrameMagnitudes(frame, frame, candidate.data());
+
+                const auto* reference = getReferenceMagnitudes(hop, channel);
+                auto result = 0.0;
+
+                for (auto bin = 0; bin < referenceSpectrum.getNumBins(); bin += binStride)
+                    result += std::fabs(std::log((1.0f + reference[bin]) / (1.0f + candidate[static_cast<size_t>(bin)])));
+
+                return result;
+            }
+
+            //==============================================================================
+            Compressor compressor;
+            ShaperFunction shaper;
+            float maximumLookAheadTime = 0.0f;
+            bool shaperEnabled = true;
+            int binStride = 1;
+
+            SlidingSpectrum referenceSpectrum;
+            std::array<std::vector<float>, maxChannels> referenceDelay, outputHistory;
+            std::vector<float> referenceMagnitudes; // per hop and channel
+            size_t referenceDelayPosition = 0, minimumHopSize = 1, hopSize = 1, numHops = 1;
+            int numAbandonedTrials = 0;
+
+            // scratch from the arena: FFT workspace and trial output
+            std::array<float*, maxChannels> workspace {}, output {};
+
+            const Compressor* production = nullptr;
+            juce::dsp::AudioBlock<const float> input, key;
+
+            JUCE_DECLARE_NON_COPYABLE(HeuristicSimulator)
+        };
+
+} // namespace dsp_original
@@ -25,8 +25,11 @@
   ==============================================================================
 */
 
-#include <omp.h>
+#pragma once
+
 #include <JuceHeader.h>
+#include <array>
+#include "GainComputer.h"
 
 namespace dsp_original
 {
@@ -56,7 +59,7 @@ namespace dsp_original
                 update();
             }
 
-            /** Sets the ratio of the compressor (must be higher or equal to 1).*/
+            /** Sets the ratio of the compressor (must be higher or equal to 1, may be infinite).*/
             void setRatio(SampleType newRatio)
             {
                 jassert(newRatio >= static_cast<SampleType> (1.0));
@@ -65,6 +68,45 @@ namespace dsp_original
                 update();
             }
 
+            /** Sets the knee width in dB of the compressor (0 for a hard knee).*/
+            void setKnee(SampleType newKnee)
+            {
+                kneedB = newKnee;
+                update();
+            }
+
+            /** Evaluates the gain curve with std::pow instead of the table, for reference renders.*/
+            void setUseExactGainCurve(bool shouldUseExactCurve)
+            {
+                gainComputer.setUseExactCurve(shouldUseExactCurve);
+            }
+
+            /** Computes the detector and the gain only every given number of samples and
+                interpolates the gain linearly in between (1 computes them for every sample).
+                The interval is limited to half the look-ahead, so the interpolated gain has
+                reached its target before the segment that caused it leaves the delay line.
+            */
+            void setControlRateInterval(int newInterval)
+            {
+                jassert(newInterval >= 1);
+
+                requestedControlInterval = newInterval;
+                update();
+            }
+
+            /** Shortens the audio path of the look-ahead delay by a number of samples,
+                without changing how far the detector looks ahead. Use this when the
+                delayed audio goes through an upsampler whose own delay makes up the rest.
+                Not copied by copyStateFrom().
+            */
+            void setDelayCompensation(int newCompensationInSamples)
+            {
+                jassert(newCompensationInSamples >= 0);
+
+                delayCompensation = static_cast<size_t>(newCompensationInSamples);
+                update();
+            }
+
             /** Sets the attack time in milliseconds of the compressor.*/
             void setAttack(SampleType newAttack)
             {
@@ -79,13 +121,32 @@ namespace dsp_original
                 update();
             }
 
-            /** Sets the look-ahead time in milliseconds of the compressor.*/
+            /** Sets the look-ahead time in milliseconds of the compressor.
+                After prepare() this must not exceed the maximum look-ahead time.
+            */
             void setLookAheadTime(SampleType newLookAheadTime)
             {
                 lookAheadTime = newLookAheadTime;
                 update();
             }
 
+            /** Sets the longest look-ahead time in milliseconds the delay buffer is sized for.
+                Takes effect on the next call to prepare().
+            */
+            void setMaximumLookAheadTime(SampleType newMaximumLookAheadTime)
+            {
+                maximumLookAheadTime = newMaximumLookAheadTime;
+            }
+
+            /** Drives a single detector with the loudest channel of each frame and applies
+                its gain to every channel, which keeps the stereo image in place. The
+                detector state of channel 0 is the shared one.
+            */
+            void setStereoLink(bool shouldLinkChannels) noexcept
+            {
+                stereoLink = shouldLinkChannels;
+            }
+
             // set M/S procesing enabled/disenabled
             void setMSProcessingEnabled(bool newValue) {
                 useMSProcessing = newValue;
@@ -103,6 +164,18 @@ namespace dsp_original
                 numChannels = spec.numChannels;
 
                 envelopeFilter.prepare(spec);
+                controlState.assign(numChannels, ControlState {});
+                gainBuffer.assign(numChannels, std::vector<SampleType>(spec.maximumBlockSize, static_cast<SampleType>(1.0)));
+                lastGain.assign(numChannels, static_cast<SampleType>(1.0));
+                controlInterval = 0; // makes update() prepare the control-rate detector
+
+                // Look-ahead delay buffer (allocated here only, never on the audio thread)
+                delayBufferSize = static_cast<size_t>(sampleRate * juce::jmax(lookAheadTime, maximumLookAheadTime) / 1000.0) + 1;
+                delayBuffer.assign(numChannels, std::vector<SampleType>(delayBufferSize, static_cast<SampleType>(0.0)));
+                delayWritePosition.assign(numChannels, 0);
+
+                // the peak stage holds up to the whole delay buffer
+                peakStages.assign(numChannels, PeakStage(static_cast<size_t>(juce::nextPowerOfTwo(static_cast<int>(delayBufferSize) + 1))));
 
                 update();
                 reset();
@@ -112,17 +185,86 @@ namespace dsp_original
             void reset()
             {
                 envelopeFilter.reset();
+                controlEnvelopeFilter.reset();
+                std::fill(controlState.begin(), controlState.end(), ControlState {});
+                std::fill(lastGain.begin(), lastGain.end(), static_cast<SampleType>(1.0));
+                minimumGain = static_cast<SampleType>(1.0);
+
+                for (auto& peakStage : peakStages)
+                    peakStage.reset(peakWindow);
+
+                for (auto& channelBuffer : delayBuffer)
+                    std::fill(channelBuffer.begin(), channelBuffer.end(), static_cast<SampleType>(0.0));
+
+                std::fill(delayWritePosition.begin(), delayWritePosition.end(), size_t {});
             }
 
+            /** Copies the settings and the whole processing state of another compressor
+                that has been prepared with the same spec, without allocating.
+            */
+            void copyStateFrom(const LookAheadCompressor& other) noexcept
+            {
+                jassert(other.numChannels == numChannels && other.delayBufferSize == delayBufferSize);
+
+                assignSettings(other);
+
+                envelopeFilter = other.envelopeFilter;
+                controlEnvelopeFilter = other.controlEnvelopeFilter;
+                controlInterval = other.controlInterval;
+                std::copy(other.controlState.begin(), other.controlState.end(), controlState.begin());
+                gainComputer.copyFrom(other.gainComputer);
+
+                for (size_t channel = 0; channel < delayBuffer.size(); ++channel)
+                    std::copy(other.delayBuffer[channel].begin(), other.delayBuffer[channel].end(), delayBuffer[channel].begin());
+
+                std::copy(other.delayWritePosition.begin(), other.delayWritePosition.end(), delayWritePosition.begin());
+
+                peakWindow = other.peakWindow;
+                peakStageActive = other.peakStageActive;
+
+                for (size_t channel = 0; channel < peakStages.size(); ++channel)
+                    peakStages[channel].copyFrom(other.peakStages[channel]);
+
+                update();
+            }
+
+            /** Returns the approximate amount of memory owned by the processor. */
+            size_t getMemoryUsageInBytes() const noexcept
+            {
+                const auto gainBufferSize = gainBuffer.empty() ? size_t {} : gainBuffer.front().size();
+                const auto peakStageSize = peakStages.empty() ? size_t {} : peakStages.front().getMemoryUsageInBytes();
+                return numChannels * ((delayBufferSize + gainBufferSize) * sizeof(SampleType) + sizeof(InnerSampleType) + sizeof(size_t) + peakStageSize);
+            }
+
+            /** Returns how far the detector looks ahead, in samples. */
             int getLatencyInSamples() const noexcept
             {
                 return static_cast<int>(sampleRate * lookAheadTime / 1000.0);
             }
 
+            /** Returns the delay of the audio path, i.e. the look-ahead minus the delay compensation. */
+            int getAudioDelayInSamples() const noexcept
+            {
+                return static_cast<int>(delayLength);
+            }
+
             //==============================================================================
             /** Processes the input and output samples supplied in the processing context. */
             template <typename ProcessContext>
             void process(const ProcessContext& context) noexcept
+            {
+                process(context, context.getInputBlock());
+            }
+
+            /** Like process(), but the detector follows a separate key signal, such as a
+                sidechain input, with the same number of samples. If the key has fewer
+                channels than the audio (e.g. a mono key), the remaining channels follow
+                its last channel. If it has more (e.g. a stereo key on mono audio), the
+                detector follows the loudest key channel of each frame, as when linked,
+                so no key channel is ignored.
+            */
+            template <typename ProcessContext>
+            void process(const ProcessContext& context, const juce::dsp::AudioBlock<const SampleType>& keyBlock) noexcept
             {
                 const auto& inputBlock = context.getInputBlock();
                 auto& outputBlock = context.getOutputBlock();
@@ -134,39 +276,172 @@ namespace dsp_original
 
                 if (context.isBypassed)
                 {
-					// TODO
-                    outputBlock.copyFrom(inputBlock);
+                    // Keep feeding the look-ahead delay so the latency stays the same when bypassed
+                    for (size_t channel = 0; channel < numChannels; ++channel)
+                    {
+                        auto* inputSamples = inputBlock.getChannelPointer(channel);
+                        auto* outputSamples = outputBlock.getChannelPointer(channel);
+
+                        for (size_t i = 0; i < numSamples; ++i)
+                            outputSamples[i] = processDelay((int)channel, inputSamples[i]);
+                    }
+
+                    minimumGain = static_cast<SampleType>(1.0);
                     return;
                 }
 
-                //#pragma omp parallel for
-                for (size_t channel = 0; channel < numChannels; ++channel)
+                // Pick the gain curve once per block rather than per sample
+                switch (gainComputer.getType())
                 {
-                    auto* inputSamples = inputBlock.getChannelPointer(channel);
-                    auto* outputSamples = outputBlock.getChannelPointer(channel);
+                    case GainCurveType::limiter: processChannels<GainCurveType::limiter, false>(keyBlock, inputBlock, outputBlock); break;
+                    case GainCurveType::table:   processChannels<GainCurveType::table, false>(keyBlock, inputBlock, outputBlock);   break;
+                    case GainCurveType::exact:   processChannels<GainCurveType::exact, false>(keyBlock, inputBlock, outputBlock);   break;
+                }
+            }
+
+            /** Runs the detector and the look-ahead delay only.
+
+                The output receives the delayed audio and the gain is kept for a following
+                call to applyGain(), so the audio can be upsampled in between and only the
+                gain has to be applied at the higher rate.
+
+                A startSample above 0 continues the gains of the previous call at that
+                position, so a block can be detected in parts with different settings
+                and still be applied with a single applyGain().
+            */
+            template <typename ProcessContext>
+            void processDetection(const ProcessContext& context, size_t startSample = 0) noexcept
+            {
+                processDetection(context, context.getInputBlock(), startSample);
+            }
+
+            /** Like processDetection(), but the detector follows a separate key signal,
+                as in process().
+            */
+            template <typename ProcessContext>
+            void processDetection(const ProcessContext& context, const juce::dsp::AudioBlock<const SampleType>& keyBlock,
+                                  size_t startSample = 0) noexcept
+            {
+                const auto& inputBlock = context.getInputBlock();
+                auto& outputBlock = context.getOutputBlock();
+
+                jassert(outputBlock.getNumChannels() <= gainBuffer.size());
+                jassert(gainBuffer.empty() || startSample + outputBlock.getNumSamples() <= gainBuffer.front().size());
+                jassert(startSample == 0 || startSample == detectedNumSamples);
+
+                detectedNumSamples = startSample + outputBlock.getNumSamples();
+
+                if (context.isBypassed)
+                {
+                    process(context);
+
+                    for (auto& channelGains : gainBuffer)
+                        std::fill(channelGains.begin() + static_cast<std::ptrdiff_t>(startSample),
+                                  channelGains.begin() + static_cast<std::ptrdiff_t>(detectedNumSamples), static_cast<SampleType>(1.0));
+                    return;
+                }
+
+                switch (gainComputer.getType())
+                {
+                    case GainCurveType::limiter: processChannels<GainCurveType::limiter, true>(keyBlock, inputBlock, outputBlock, startSample); break;
+                    case GainCurveType::table:   processChannels<GainCurveType::table, true>(keyBlock, inputBlock, outputBlock, startSample);   break;
+                    case GainCurveType::exact:   processChannels<GainCurveType::exact, true>(keyBlock, inputBlock, outputBlock, startSample);   break;
+                }
+            }
+
+            /** Applies the gain found by the last processDetection() call to an upsampled
+                version of its output, interpolating linearly between the gain values.
+            */
+            template <typename ProcessContext>
+            void applyGain(const ProcessContext& context) noexcept
+            {
+                if (context.isBypassed || detectedNumSamples == 0)
+                    return;
 
-                    for (size_t i = 0; i < numSamples; ++i)
-                        outputSamples[i] = processSample((int)channel, inputSamples[i]);
+                auto& block = context.getOutputBlock();
+                const auto factor = block.getNumSamples() / detectedNumSamples;
+                const auto factorInverse = static_cast<SampleType>(1.0) / static_cast<SampleType>(factor);
+
+                jassert(factor * detectedNumSamples == block.getNumSamples());
+
+                if (isLinked(block.getNumChannels()) && factor <= maxRampLength)
+                {
+                    applyLinkedGain(block, factor, factorInverse);
+                    return;
                 }
+
+                for (size_t channel = 0; channel < juce::jmin(block.getNumChannels(), gainBuffer.size()); ++channel)
+                {
+                    auto* samples = block.getChannelPointer(channel);
+                    const auto* gains = gainBuffer[channel].data();
+                    auto previous = lastGain[channel];
+
+                    for (size_t i = 0; i < detectedNumSamples; ++i)
+                    {
+                        const auto step = (gains[i] - previous) * factorInverse;
+                        auto gain = previous;
+
+                        for (size_t j = 0; j < factor; ++j)
+                        {
+                            gain += step;
+                            *samples++ *= gain;
+                        }
+
+                        previous = gains[i];
+                    }
+
+                    lastGain[channel] = previous;
+                }
+            }
+
+            /** Returns the smallest gain of the last process() call, or of all parts of the
+                last processDetection() block, for metering.
+            */
+            SampleType getMinimumGainOfLastBlock() const noexcept
+            {
+                return minimumGain;
             }
 
             /** Performs the processing operation on a single sample at a time. */
             SampleType processSample(int channel, SampleType inputValue)
             {
-                // Ballistics filter with peak rectifier
-                auto env = envelopeFilter.processSample(channel, inputValue);
+                switch (gainComputer.getType())
+                {
+                    case GainCurveType::limiter: return processSampleWithCurve<GainCurveType::limiter>(channel, inputValue);
+                    case GainCurveType::table:   return processSampleWithCurve<GainCurveType::table>(channel, inputValue);
+                    case GainCurveType::exact:   break;
+                }
 
-                // VCA
-                auto gain = (env < threshold) ? static_cast<SampleType>(1.0)
-                    : std::pow(env * thresholdInverse, ratioInverse - static_cast<SampleType>(1.0));
+                return processSampleWithCurve<GainCurveType::exact>(channel, inputValue);
+            }
 
-				// Look-ahead delay
-				delayBuffer[channel].push_back(inputValue); // Store the current input sample in the delay buffer
+            /** Performs the processing operation on a single sample with a fixed gain curve. */
+            template <GainCurveType curveType>
+            SampleType processSampleWithCurve(int channel, SampleType inputValue) noexcept
+            {
+                // Detector and VCA
+                auto gain = computeGain<curveType>(static_cast<size_t>(channel), inputValue);
 
-                // Output
-                auto output = gain * delayBuffer[channel].front();
-                delayBuffer[channel].pop_front();
-                return output;
+                // Look-ahead delay
+                return gain * processDelay(channel, inputValue);
+            }
+
+            /** Pushes a sample through the look-ahead delay only. */
+            SampleType processDelay(int channel, SampleType inputValue) noexcept
+            {
+                auto& channelBuffer = delayBuffer[static_cast<size_t>(channel)];
+                auto& writePosition = delayWritePosition[static_cast<size_t>(channel)];
+
+                channelBuffer[writePosition] = inputValue; // Store the current input sample in the delay buffer
+
+                auto readPosition = writePosition + delayBufferSize - delayLength;
+                if (readPosition >= delayBufferSize)
+                    readPosition -= delayBufferSize;
+
+                if (++writePosition == delayBufferSize)
+                    writePosition = 0;
+
+                return channelBuffer[readPosition];
             }
 
    //         SampleType processSampleMSSingle(int channel, SampleType inputValue)
@@ -190,19 +465,235 @@ namespace dsp_original
 
         private:
             //==============================================================================
+            template <GainCurveType curveType, bool detectionOnly, typename InputBlockType, typename OutputBlockType>
+            void processChannels(const juce::dsp::AudioBlock<const SampleType>& keyBlock, const InputBlockType& inputBlock,
+                                 OutputBlockType& outputBlock, size_t gainOffset = 0) noexcept
+            {
+                jassert(keyBlock.getNumChannels() > 0 && keyBlock.getNumSamples() >= outputBlock.getNumSamples());
+
+                // a block continued at a gain offset keeps the minimum of its earlier parts
+                auto blockMinimumGain = gainOffset > 0 ? minimumGain : static_cast<SampleType>(1.0);
+
+                // a key with more channels than the audio is folded into one detector (max of the channels)
+                if (isLinked(outputBlock.getNumChannels())
+                    || (keyBlock.getNumChannels() > outputBlock.getNumChannels() && outputBlock.getNumChannels() <= maxLinkedChannels))
+                {
+                    minimumGain = processLinkedFrames<curveType, detectionOnly>(keyBlock, inputBlock, outputBlock, gainOffset, blockMinimumGain);
+                    return;
+                }
+
+                for (size_t channel = 0; channel < outputBlock.getNumChannels(); ++channel)
+                {
+                    auto* keySamples = keyBlock.getChannelPointer(juce::jmin(channel, keyBlock.getNumChannels() - 1));
+                    auto* inputSamples = inputBlock.getChannelPointer(channel);
+                    auto* outputSamples = outputBlock.getChannelPointer(channel);
+
+                    for (size_t i = 0; i < outputBlock.getNumSamples(); ++i)
+                    {
+                        const auto inputValue = inputSamples[i];
+                        const auto gain = computeGain<curveType>(channel, keySamples[i]);
+                        blockMinimumGain = juce::jmin(blockMinimumGain, gain);
+
+                        if constexpr (detectionOnly)
+                        {
+                            gainBuffer[channel][gainOffset + i] = gain;
+                            outputSamples[i] = processDelay((int)channel, inputValue);
+                        }
+                        else
+                        {
+                            outputSamples[i] = gain * processDelay((int)channel, inputValue);
+                        }
+                    }
+                }
+
+                minimumGain = blockMinimumGain;
+            }
+
+            bool isLinked(size_t numChannelsInBlock) const noexcept
+            {
+                return stereoLink && numChannelsInBlock > 1 && numChannelsInBlock <= maxLinkedChannels;
+            }
+
+            /** Processes frame by frame: one detector step on the loudest key channel, then
+                the delay and the shared gain for every channel.
+            */
+            template <GainCurveType curveType, bool detectionOnly, typename InputBlockType, typename OutputBlockType>
+            SampleType processLinkedFrames(const juce::dsp::AudioBlock<const SampleType>& keyBlock, const InputBlockType& inputBlock,
+                                           OutputBlockType& outputBlock, size_t gainOffset, SampleType blockMinimumGain) noexcept
+            {
+                const auto numChannelsInBlock = outputBlock.getNumChannels();
+                const auto numKeyChannels = juce::jmin(keyBlock.getNumChannels(), static_cast<size_t>(maxLinkedChannels));
+                std::array<const SampleType*, maxLinkedChannels> keys {}, inputs {};
+                std::array<SampleType*, maxLinkedChannels> outputs {};
+
+                for (size_t channel = 0; channel < numKeyChannels; ++channel)
+                    keys[channel] = keyBlock.getChannelPointer(channel);
+
+                for (size_t channel = 0; channel < numChannelsInBlock; ++channel)
+                {
+                    inputs[channel] = inputBlock.getChannelPointer(channel);
+                    outputs[channel] = outputBlock.getChannelPointer(channel);
+                }
+
+                for (size_t i = 0; i < outputBlock.getNumSamples(); ++i)
+                {
+                    auto level = static_cast<SampleType>(0.0);
+
+                    for (size_t channel = 0; channel < numKeyChannels; ++channel)
+                        level = juce::jmax(level, std::abs(keys[channel][i]));
+
+                    const auto gain = computeGain<curveType>(0, level);
+                    blockMinimumGain = juce::jmin(blockMinimumGain, gain);
+
+                    for (size_t channel = 0; channel < numChannelsInBlock; ++channel)
+                    {
+                        const auto inputValue = inputs[channel][i];
+
+                        if constexpr (detectionOnly)
+                        {
+                            gainBuffer[channel][gainOffset + i] = gain;
+                            outputs[channel][i] = processDelay((int)channel, inputValue);
+                        }
+                        else
+                        {
+                            outputs[channel][i] = gain * processDelay((int)channel, inputValue);
+                        }
+                    }
+                }
+
+                return blockMinimumGain;
+            }
+
+            /** applyGain() for linked channels: the interpolated ramp is computed once per
+                detected sample and multiplied into every channel.
+            */
+            template <typename BlockType>
+            void applyLinkedGain(BlockType& block, size_t factor, SampleType factorInverse) noexcept
+            {
+                const auto numChannelsInBlock = juce::jmin(block.getNumChannels(), gainBuffer.size());
+                const auto* gains = gainBuffer.front().data();
+                auto previous = lastGain.front();
+                std::array<SampleType, maxRampLength> ramp;
+
+                for (size_t i = 0; i < detectedNumSamples; ++i)
+                {
+                    const auto step = (gains[i] - previous) * factorInverse;
+
+                    for (size_t j = 0; j < factor; ++j)
+                        ramp[j] = previous + step * static_cast<SampleType>(j + 1);
+
+                    for (size_t channel = 0; channel < numChannelsInBlock; ++channel)
+                    {
+                        auto* samples = block.getChannelPointer(channel) + i * factor;
+
+                        for (size_t j = 0; j < factor; ++j)
+                            samples[j] *= ramp[j];
+                    }
+
+                    previous = gains[i];
+                }
+
+                std::fill(lastGain.begin(), lastGain.end(), previous);
+            }
+
+            /** Runs the detector for one sample and returns the gain to apply to it. */
+            template <GainCurveType curveType>
+            SampleType computeGain(size_t channel, SampleType inputValue) noexcept
+            {
+                const auto gain = computeEnvelopeGain<curveType>(channel, inputValue);
+
+                if (! peakStageActive)
+                    return gain;
+
+                // the gain that keeps this sample of the key at full scale
+                const auto level = std::abs(inputValue);
+                const auto fullScaleGain = level > static_cast<SampleType>(1.0) ? static_cast<SampleType>(1.0) / level : static_cast<SampleType>(1.0);
+
+                return juce::jmin(gain, peakStages[channel].process(fullScaleGain, peakWindow));
+            }
+
+            /** The gain of the envelope follower alone, per sample or at the control rate. */
+            template <GainCurveType curveType>
+            SampleType computeEnvelopeGain(size_t channel, SampleType inputValue) noexcept
+            {
+                if (controlInterval <= 1)
+                {
+                    // Ballistics filter with peak rectifier
+                    auto env = envelopeFilter.processSample((int)channel, inputValue);
+                    return gainComputer.template getGain<curveType>(env);
+                }
+
+                auto& state = controlState[channel];
+
+                // keep the segment maximum so short peaks are not skipped
+                state.peak = juce::jmax(state.peak, std::abs(inputValue));
+
+                const auto gain = state.gain;
+                state.gain += state.gainIncrement;
+
+                if (++state.position >= controlInterval)
+                {
+                    auto env = controlEnvelopeFilter.processSample((int)channel, state.peak);
+                    auto target = gainComputer.template getGain<curveType>(env);
+
+                    state.gainIncrement = (target - state.gain) / static_cast<SampleType>(controlInterval);
+                    state.position = 0;
+                    state.peak = static_cast<SampleType>(0.0);
+                }
+
+                return gain;
+            }
+
+            void assignSettings(const LookAheadCompressor& other) noexcept
+            {
+                thresholddB = other.thresholddB;
+                ratio = other.ratio;
+                kneedB = other.kneedB;
+                attackTime = other.attackTime;
+                releaseTime = other.releaseTime;
+                lookAheadTime = other.lookAheadTime;
+                maximumLookAheadTime = other.maximumLookAheadTime;
+                useMSProcessing = other.useMSProcessing;
+                stereoLink = other.stereoLink;
+                requestedControlInterval = other.requestedControlInterval;
+            }
+
             void update()
             {
-                threshold = juce::Decibels::decibelsToGain(thresholddB, static_cast<SampleType> (-200.0));
-                thresholdInverse = static_cast<SampleType> (1.0) / threshold;
-                ratioInverse = static_cast<SampleType> (1.0) / ratio;
+                // only rebuilds the gain table when threshold, ratio or knee have changed
+                gainComputer.setParameters(thresholddB, ratio, kneedB);
 
                 envelopeFilter.setAttackTime(attackTime);
                 envelopeFilter.setReleaseTime(releaseTime);
+                controlEnvelopeFilter.setAttackTime(attackTime);
+                controlEnvelopeFilter.setReleaseTime(releaseTime);
+
+                // the delay buffer itself is only resized in prepare()
+                const auto lookAheadSamples = static_cast<size_t>(getLatencyInSamples());
+                jassert(delayBufferSize == 0 || lookAheadSamples < delayBufferSize);
+
+                delayLength = juce::jmin(lookAheadSamples - juce::jmin(delayCompensation, lookAheadSamples),
+                                         delayBufferSize > 0 ? delayBufferSize - 1 : size_t {});
+
+                // the peak stage only runs with an infinite ratio and restarts when its window changes
+                const auto newPeakWindow = delayBufferSize > 0 ? juce::jmin(lookAheadSamples, delayBufferSize - 1) + 1 : size_t { 1 };
+                const auto newPeakStageActive = std::isinf(ratio);
+
+                if (newPeakWindow != peakWindow || (newPeakStageActive && ! peakStageActive))
+                    for (auto& peakStage : peakStages)
+                        peakStage.reset(newPeakWindow);
+
+                peakWindow = newPeakWindow;
+                peakStageActive = newPeakStageActive;
+
+                // the control-rate detector runs at sampleRate / interval
+                const auto newControlInterval = juce::jlimit(1, juce::jmax(1, static_cast<int>(lookAheadSamples / 2)), requestedControlInterval);
 
-                delayBuffer.resize(numChannels);
-                for (auto& channelBuffer : delayBuffer) {
-					channelBuffer.clear();
-                    channelBuffer.resize(getLatencyInSamples(), 0.0); // Look-ahead delay buffer
+                if (newControlInterval != controlInterval && numChannels > 0)
+                {
+                    controlInterval = newControlInterval;
+                    controlEnvelopeFilter.prepare({ sampleRate / controlInterval, 1, numChannels }); // no allocation after the first call
+                    std::fill(controlState.begin(), controlState.end(), ControlState {});
                 }
             }
 
@@ -222,14 +713,112 @@ namespace dsp_original
             //}
 
             //==============================================================================
-            SampleType threshold, thresholdInverse, ratioInverse;
-            juce::dsp::BallisticsFilter<InnerSampleType> envelopeFilter;
-            std::vector<std::deque<SampleType>> delayBuffer;
+            struct ControlState
+            {
+                int position = 0;
+                SampleType peak = 0, gain = 1, gainIncrement = 0;
+            };
+
+            /** Fast-attack peak stage: the smallest full-scale gain of the last window
+                samples (window = look-ahead + 1), averaged over as many samples. The average
+                has reached a peak's gain by the time the peak leaves the delay line, and it
+                ramps there over the look-ahead instead of stepping. It only catches what the
+                envelope lets through above 0 dBFS, so the searched attack and release still
+                shape everything between the threshold and full scale.
+            */
+            class PeakStage
+            {
+            public:
+                explicit PeakStage(size_t capacity)
+                    : candidateGains(capacity), candidateIndices(capacity), heldGains(capacity), mask(capacity - 1)
+                {
+                    jassert(juce::isPowerOfTwo(capacity));
+                }
+
+                void reset(size_t window) noexcept
+                {
+                    jassert(window > 0 && window < candidateGains.size());
+
+                    std::fill(heldGains.begin(), heldGains.end(), static_cast<SampleType>(1.0));
+                    heldSum = static_cast<InnerSampleType>(window);
+                    sampleIndex = 0;
+                    front = back = 0;
+                    heldPosition = 0;
+                }
+
+                void copyFrom(const PeakStage& other) noexcept
+                {
+                    std::copy(other.candidateGains.begin(), other.candidateGains.end(), candidateGains.begin());
+                    std::copy(other.candidateIndices.begin(), other.candidateIndices.end(), candidateIndices.begin());
+                    std::copy(other.heldGains.begin(), other.heldGains.end(), heldGains.begin());
+                    heldSum = other.heldSum;
+                    sampleIndex = other.sampleIndex;
+                    front = other.front;
+                    back = other.back;
+                    heldPosition = other.heldPosition;
+                }
+
+                SampleType process(SampleType gain, size_t window) noexcept
+                {
+                    // sliding minimum (candidates with increasing gains, oldest first)
+                    while (back != front && candidateGains[(back - 1) & mask] >= gain)
+                        --back;
+
+                    candidateGains[back & mask] = gain;
+                    candidateIndices[back & mask] = sampleIndex;
+                    ++back;
+
+                    if (candidateIndices[front & mask] + window <= sampleIndex)
+                        ++front;
+
+                    // moving average of the held minimum
+                    const auto held = candidateGains[front & mask];
+                    heldSum += static_cast<InnerSampleType>(held) - static_cast<InnerSampleType>(heldGains[heldPosition]);
+                    heldGains[heldPosition] = held;
+
+                    if (++heldPosition == window)
+                        heldPosition = 0;
+
+                    ++sampleIndex;
+                    return static_cast<SampleType>(heldSum / static_cast<InnerSampleType>(window));
+                }
+
+                size_t getMemoryUsageInBytes() const noexcept
+                {
+                    return candidateGains.size() * (2 * sizeof(SampleType) + sizeof(size_t));
+                }
+
+            private:
+                std::vector<SampleType> candidateGains;
+                std::vector<size_t> candidateIndices;
+                std::vector<SampleType> heldGains;
+                InnerSampleType heldSum = 1;
+                size_t mask, sampleIndex = 0, front = 0, back = 0, heldPosition = 0;
+            };
+
+            GainComputer<SampleType> gainComputer;
+            juce::dsp::BallisticsFilter<InnerSampleType> envelopeFilter, controlEnvelopeFilter;
+            std::vector<ControlState> controlState;
+            int requestedControlInterval = 1, controlInterval = 1;
+            std::vector<std::vector<SampleType>> delayBuffer;
+            std::vector<size_t> delayWritePosition;
+            size_t delayBufferSize = 0, delayLength = 0, delayCompensation = 0;
+            std::vector<PeakStage> peakStages;
+            size_t peakWindow = 1;
+            bool peakStageActive = false;
+
+            // gain of the last processDetection() call, for applyGain()
+            std::vector<std::vector<SampleType>> gainBuffer;
+            std::vector<SampleType> lastGain;
+            size_t detectedNumSamples = 0;
+            SampleType minimumGain = 1.0;
 
             double sampleRate = 44100.0;
 			juce::uint32 numChannels = 0;
-            SampleType thresholddB = 0.0, ratio = 1.0, attackTime = 1.0, releaseTime = 100.0, lookAheadTime = 5.0;
-            bool useMSProcessing = false;
+            SampleType thresholddB = 0.0, ratio = 1.0, kneedB = 0.0, attackTime = 1.0, releaseTime = 100.0, lookAheadTime = 5.0, maximumLookAheadTime = 0.0;
+            bool useMSProcessing = false, stereoLink = false;
+
+            static constexpr size_t maxLinkedChannels = 8, maxRampLength = 64;
         };
 
 } // namespace juce
@@ -0,0 +1,285 @@
+/*
+  ==============================================================================
+
+    LoudnessMeter.h
+    Streaming ITU-R BS.1770 / EBU R128 loudness measurement.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+namespace dsp_original
+{
+
+        /**
+            K-weighted momentary, short-term and integrated loudness of a stream.
+
+            Energy is accumulated over 100 ms hops. The momentary (400 ms) and
+            short-term (3 s) values are averaged from a ring of the latest hops. The
+            gating blocks for the integrated value go into a fixed 0.1 LU histogram,
+            so memory and CPU do not grow with the length of the programme.
+
+            All results are published through atomics and may be read from any thread.
+        */
+        class LoudnessMeter
+        {
+        public:
+            static constexpr int maxChannels = 2;
+            static constexpr float silence = -100.0f;
+
+            /** A snapshot of the published values in LUFS. */
+            struct Report
+            {
+                float momentary = silence, shortTerm = silence, integrated = silence;
+                float maxMomentary = silence, maxShortTerm = silence;
+            };
+
+            LoudnessMeter() = default;
+
+            //==============================================================================
+            /** Computes the K-weighting filters for the sample rate and clears everything. */
+            void prepare(double sampleRate, int numChannelsToUse)
+            {
+                jassert(sampleRate > 0);
+
+                numChannels = juce::jlimit(1, maxChannels, numChannelsToUse);
+                samplesPerHop = juce::jmax(1, juce::roundToInt(sampleRate * 0.1));
+
+                // Stage 1: high shelf
+                {
+                    const auto K = std::tan(juce::MathConstants<double>::pi * 1681.974450955533 / sampleRate);
+                    const auto Q = 0.7071752369554196;
+                    const auto Vh = std::pow(10.0, 3.999843853973347 / 20.0);
+                    const auto Vb = std::pow(Vh, 0.4996667741545416);
+                    const auto a0 = 1.0 + K / Q + K * K;
+
+                    shelf = { (Vh + Vb * K / Q + K * K) / a0, 2.0 * (K * K - Vh) / a0, (Vh - Vb * K / Q + K * K) / a0,
+                              2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0 };
+                }
+
+                // Stage 2: RLB high pass
+                {
+                    const auto K = std::tan(juce::MathConstants<double>::pi * 38.13547087602444 / sampleRate);
+                    const auto Q = 0.5003270373238773;
+                    const auto a0 = 1.0 + K / Q + K * K;
+
+                    highPass = { 1.0, -2.0, 1.0, 2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0 };
+                }
+
+                reset();
+            }
+
+            /** Clears the filters, the hop history and the integrated histogram. */
+            void reset() noexcept
+            {
+                for (auto& state : shelfState)    state = {};
+                for (auto& state : highPassState) state = {};
+
+                hopEnergies.fill(0.0);
+                hopIndex = 0;
+                numHops = 0;
+                hopSamples = 0;
+                hopEnergy = 0.0;
+
+                histogramCounts.fill(0);
+                histogramEnergies.fill(0.0);
+
+                maxMomentaryEnergy = maxShortTermEnergy = 0.0;
+                publish(0.0, 0.0);
+                integrated.store(silence);
+            }
+
+            /** Asks the audio thread to restart the measurement; may be called from any thread. */
+            void resetStatistics() noexcept
+            {
+                resetRequested.store(true);
+            }
+
+            //==============================================================================
+            /** Feeds a block of output samples. */
+            template <typename SampleType>
+            void process(const juce::dsp::AudioBlock<SampleType>& block) noexcept
+            {
+                if (resetRequested.exchange(false))
+                    reset();
+
+                const auto numChannelsToProcess = juce::jmin(static_cast<size_t>(numChannels), block.getNumChannels());
+                size_t position = 0;
+
+                while (position < block.getNumSamples())
+                {
+                    const auto numThisTime = juce::jmin(block.getNumSamples() - position,
+                                                        static_cast<size_t>(samplesPerHop - hopSamples));
+
+                    for (size_t channel = 0; channel < numChannelsToProcess; ++channel)
+                    {
+                        const auto* samples = block.getChannelPointer(channel) + position;
+                        auto& s1 = shelfState[channel];
+                        auto& s2 = highPassState[channel];
+                        auto sum = 0.0;
+
+                        for (size_t i = 0; i < numThisTime; ++i)
+                        {
+                            const auto y = processBiquad(highPass, s2, processBiquad(shelf, s1, static_cast<double>(samples[i])));
+                            sum += y * y;
+                        }
+
+                        hopEnergy += sum;
+                    }
+
+                    position += numThisTime;
+                    hopSamples += static_cast<int>(numThisTime);
+
+                    if (hopSamples == samplesPerHop)
+                        finishHop();
+                }
+            }
+
+            //==============================================================================
+            Report getReport() const noexcept
+            {
+                Report report;
+                report.momentary = momentary.load(std::memory_order_relaxed);
+                report.shortTerm = shortTerm.load(std::memory_order_relaxed);
+                report.integrated = integrated.load(std::memory_order_relaxed);
+                report.maxMomentary = maxMomentary.load(std::memory_order_relaxed);
+                report.maxShortTerm = maxShortTerm.load(std::memory_order_relaxed);
+                return report;
+            }
+
+        private:
+            //==============================================================================
+            struct BiquadCoefficients { double b0, b1, b2, a1, a2; };
+            struct BiquadState { double z1 = 0.0, z2 = 0.0; };
+
+            static double processBiquad(const BiquadCoefficients& c, BiquadState& s, double x) noexcept
+            {
+                const auto y = c.b0 * x + s.z1;
+                s.z1 = c.b1 * x - c.a1 * y + s.z2;
+                s.z2 = c.b2 * x - c.a2 * y;
+                return y;
+            }
+
+            static constexpr int hopsPerMomentary = 4, hopsPerShortTerm = 30;
+            static constexpr float histogramMinimum = -70.0f, histogramMaximum = 10.0f, histogramStep = 0.1f;
+            static constexpr int numHistogramBins = static_cast<int>((histogramMaximum - histogramMinimum) / histogramStep);
+
+            static float energyToLoudness(double energy) noexcept
+            {
+                return energy > 0.0 ? static_cast<float>(-0.691 + 10.0 * std::log10(energy)) : silence;
+            }
+
+            double getMeanEnergy(int numHopsToAverage) const noexcept
+            {
+                const auto numAvailable = juce::jmin(numHopsToAverage, numHops);
+                auto sum = 0.0;
+
+                for (int i = 1; i <= numAvailable; ++i)
+                    sum += hopEnergies[static_cast<size_t>((hopIndex - i + hopsPerShortTerm) % hopsPerShortTerm)];
+
+                return numAvailable > 0 ? sum / numHopsToAverage : 0.0;
+            }
+
+            void finishHop() noexcept
+            {
+                hopEnergies[static_cast<size_t>(hopIndex)] = hopEnergy / samplesPerHop;
+                hopIndex = (hopIndex + 1) % hopsPerShortTerm;
+                numHops = juce::jmin(numHops + 1, hopsPerShortTerm);
+                hopEnergy = 0.0;
+                hopSamples = 0;
+
+                const auto momentaryEnergy = getMeanEnergy(hopsPerMomentary);
+                const auto shortTermEnergy = getMeanEnergy(hopsPerShortTerm);
+
+                // each hop completes one 400 ms gating block (75 % overlap)
+                if (numHops >= hopsPerMomentary)
+                    addGatingBlock(momentaryEnergy);
+
+                publish(momentaryEnergy, numHops >= hopsPerShortTerm ? shortTermEnergy : 0.0);
+            }
+
+            void addGatingBlock(double energy) noexcept
+            {
+                const auto loudness = energyToLoudness(energy);
+
+                // absolute gate
+                if (loudness <= histogramMinimum)
+                    return;
+
+                const auto bin = juce::jlimit(0, numHistogramBins - 1,
+                                              static_cast<int>((loudness - histogramMinimum) / histogramStep));
+                ++histogramCounts[static_cast<size_t>(bin)];
+                histogramEnergies[static_cast<size_t>(bin)] += energy;
+
+                integrated.store(computeIntegratedLoudness(), std::memory_order_relaxed);
+            }
+
+            /** Applies the relative gate on the histogram, O(number of bins). */
+            float computeIntegratedLoudness() const noexcept
+            {
+                auto totalEnergy = 0.0;
+                juce::int64 totalCount = 0;
+
+                for (int bin = 0; bin < numHistogramBins; ++bin)
+                {
+                    totalEnergy += histogramEnergies[static_cast<size_t>(bin)];
+                    totalCount += histogramCounts[static_cast<size_t>(bin)];
+                }
+
+                if (totalCount == 0)
+                    return silence;
+
+                const auto relativeGate = energyToLoudness(totalEnergy / static_cast<double>(totalCount)) - 10.0f;
+                auto gatedEnergy = 0.0;
+                juce::int64 gatedCount = 0;
+
+                for (int bin = 0; bin < numHistogramBins; ++bin)
+                {
+                    // a bin is kept when its centre is above the relative gate
+                    if (histogramMinimum + (static_cast<float>(bin) + 0.5f) * histogramStep > relativeGate)
+                    {
+                        gatedEnergy += histogramEnergies[static_cast<size_t>(bin)];
+                        gatedCount += histogramCounts[static_cast<size_t>(bin)];
+                    }
+                }
+
+                return gatedCount > 0 ? energyToLoudness(gatedEnergy / static_cast<double>(gatedCount)) : silence;
+            }
+
+            void publish(double momentaryEnergy, double shortTermEnergy) noexcept
+            {
+                maxMomentaryEnergy = juce::jmax(maxMomentaryEnergy, momentaryEnergy);
+                maxShortTermEnergy = juce::jmax(maxShortTermEnergy, shortTermEnergy);
+
+                momentary.store(energyToLoudness(momentaryEnergy), std::memory_order_relaxed);
+                shortTerm.store(energyToLoudness(shortTermEnergy), std::memory_order_relaxed);
+                maxMomentary.store(energyToLoudness(maxMomentaryEnergy), std::memory_order_relaxed);
+                maxShortTerm.store(energyToLoudness(maxShortTermEnergy), std::memory_order_relaxed);
+            }
+
+            //==============================================================================
+            BiquadCoefficients shelf {}, highPass {};
+            std::array<BiquadState, maxChannels> shelfState {}, highPassState {};
+            int numChannels = maxChannels, samplesPerHop = 4800;
+
+            std::array<double, hopsPerShortTerm> hopEnergies {};
+            int hopIndex = 0, numHops = 0, hopSamples = 0;
+            double hopEnergy = 0.0;
+
+            std::array<juce::int64, numHistogramBins> histogramCounts {};
+            std::array<double, numHistogramBins> histogramEnergies {};
+            double maxMomentaryEnergy = 0.0, maxShortTermEnergy = 0.0;
+
+            std::atomic<float> momentary { silence }, shortTerm { silence }, integrated { silence };
+            std::atomic<float> maxMomentary { silence }, maxShortTerm { silence };
+            std::atomic<bool> resetRequested { false };
+
+            JUCE_DECLARE_NON_COPYABLE(LoudnessMeter)
+        };
+
+} // namespace dsp_original
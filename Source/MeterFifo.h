@@ -0,0 +1,70 @@
+/*
+  ==============================================================================
+
+    MeterFifo.h
+    Lock-free queue of meter frames from the audio thread to the editor.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+
+namespace dsp_original
+{
+
+        /**
+            A single-producer, single-consumer queue of small, trivially copyable
+            frames. It is built on juce::AbstractFifo with storage that lives inside
+            the object.
+
+            The audio thread pushes and never waits. If the reader falls behind, for
+            example because no editor is open, new frames are dropped instead of
+            overwriting ones that are being read.
+        */
+        template <typename FrameType, int capacity>
+        class MeterFifo
+        {
+        public:
+            MeterFifo() = default;
+
+            /** Adds a frame; returns false if the queue was full. Audio thread only. */
+            bool push(const FrameType& frame) noexcept
+            {
+                int start1, size1, start2, size2;
+                fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+                if (size1 > 0)
+                    frames[static_cast<size_t>(start1)] = frame;
+
+                fifo.finishedWrite(size1);
+                return size1 > 0;
+            }
+
+            /** Calls the function with every waiting frame, oldest first. Reader thread only. */
+            template <typename Function>
+            void popAll(Function&& function)
+            {
+                int start1, size1, start2, size2;
+                fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+                for (int i = 0; i < size1; ++i)
+                    function(frames[static_cast<size_t>(start1 + i)]);
+
+                for (int i = 0; i < size2; ++i)
+                    function(frames[static_cast<size_t>(start2 + i)]);
+
+                fifo.finishedRead(size1 + size2);
+            }
+
+        private:
+            //==============================================================================
+            juce::AbstractFifo fifo { capacity };
+            std::array<FrameType, capacity> frames {};
+
+            JUCE_DECLARE_NON_COPYABLE(MeterFifo)
+        };
+
+} // namespace dsp_original
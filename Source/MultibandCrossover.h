@@ -0,0 +1,141 @@
+/*
+  ==============================================================================
+
+    MultibandCrossover.h
+    Phase-coherent Linkwitz-Riley band splitter for up to five bands.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+
+namespace dsp_original
+{
+
+        /**
+            Splits a signal into 1 to maxBands bands with 4th-order Linkwitz-Riley filters.
+
+            The bands are split off one after another, from the lowest up. Each lower
+            band then goes through the allpass of every crossover above it, so all
+            bands carry the same phase response. Their sum is an allpass of the input,
+            with a flat magnitude and no added latency.
+        */
+        template <typename SampleType>
+        class MultibandCrossover
+        {
+        public:
+            static constexpr int maxBands = 5;
+            using Frequencies = std::array<SampleType, maxBands - 1>;
+
+            MultibandCrossover()
+            {
+                for (auto& row : allpasses)
+                    for (auto& filter : row)
+                        filter.setType(juce::dsp::LinkwitzRileyFilterType::allpass);
+            }
+
+            //==============================================================================
+            /** Prepares every filter, so changing the number of bands later does not allocate. */
+            void prepare(const juce::dsp::ProcessSpec& spec)
+            {
+                sampleRate = spec.sampleRate;
+
+                for (auto& filter : splitters)
+                    filter.prepare(spec);
+
+                for (auto& row : allpasses)
+                    for (auto& filter : row)
+                        filter.prepare(spec);
+
+                reset();
+            }
+
+            void reset() noexcept
+            {
+                for (auto& filter : splitters)
+                    filter.reset();
+
+                for (auto& row : allpasses)
+                    for (auto& filter : row)
+                        filter.reset();
+            }
+
+            /** Sets the number of bands and the numBands - 1 ascending crossover frequencies in Hz.
+                Clears the filter state when the number of bands changes.
+            */
+            void setBands(int newNumBands, const Frequencies& newFrequencies) noexcept
+            {
+                jassert(newNumBands >= 1 && newNumBands <= maxBands);
+
+                const auto maximumFrequency = static_cast<SampleType>(0.45 * sampleRate);
+
+                for (int i = 0; i < maxBands - 1; ++i)
+                {
+                    const auto frequency = juce::jmin(newFrequencies[static_cast<size_t>(i)], maximumFrequency);
+                    splitters[static_cast<size_t>(i)].setCutoffFrequency(frequency);
+
+                    for (auto& row : allpasses)
+                        row[static_cast<size_t>(i)].setCutoffFrequency(frequency);
+                }
+
+                if (newNumBands != numBands)
+                {
+                    numBands = newNumBands;
+                    reset();
+                }
+            }
+
+            int getNumBands() const noexcept { return numBands; }
+
+            //==============================================================================
+            /** Writes one block per band. Each band block needs as many channels and samples as the input. */
+            void process(const juce::dsp::AudioBlock<const SampleType>& input,
+                         std::array<juce::dsp::AudioBlock<SampleType>, maxBands>& bandBlocks) noexcept
+            {
+                const auto lastBand = static_cast<size_t>(numBands - 1);
+
+                for (size_t channel = 0; channel < input.getNumChannels(); ++channel)
+                {
+                    const auto* inputSamples = input.getChannelPointer(channel);
+                    std::array<SampleType*, maxBands> outputs {};
+
+                    for (size_t band = 0; band <= lastBand; ++band)
+                        outputs[band] = bandBlocks[band].getChannelPointer(channel);
+
+                    for (size_t i = 0; i < input.getNumSamples(); ++i)
+                    {
+                        auto rest = inputSamples[i];
+
+                        for (size_t band = 0; band < lastBand; ++band)
+                        {
+                            SampleType low, high;
+                            splitters[band].processSample(static_cast<int>(channel), rest, low, high);
+
+                            // the crossovers this band has not been through yet
+                            for (auto above = band + 1; above < lastBand; ++above)
+                                low = allpasses[band][above].processSample(static_cast<int>(channel), low);
+
+                            outputs[band][i] = low;
+                            rest = high;
+                        }
+
+                        outputs[lastBand][i] = rest;
+                    }
+                }
+            }
+
+        private:
+            //==============================================================================
+            std::array<juce::dsp::LinkwitzRileyFilter<SampleType>, maxBands - 1> splitters;
+            std::array<std::array<juce::dsp::LinkwitzRileyFilter<SampleType>, maxBands - 1>, maxBands - 1> allpasses;
+
+            double sampleRate = 44100.0;
+            int numBands = 1;
+
+            JUCE_DECLARE_NON_COPYABLE(MultibandCrossover)
+        };
+
+} // namespace dsp_original
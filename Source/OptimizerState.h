@@ -0,0 +1,135 @@
+/*
+  ==============================================================================
+
+    OptimizerState.h
+    Compact, versioned snapshot of the attack/release search for the plugin state.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+
+namespace dsp_original
+{
+
+        /**
+            The operating point and statistics of the attack/release search of each
+            band, stored as a small binary chunk so a reloaded session can start the
+            search warm.
+
+            The chunk is base64 text, so it fits in an XML attribute next to the
+            parameters. All values are little-endian.
+
+            - 4 bytes: magic "HLop"
+            - 1 byte:  version
+            - 1 byte:  size of one band record in bytes
+            - 1 byte:  number of band records
+            - each band record:
+              - float attack (ms)
+              - float release (ms)
+              - uint32 number of searches
+              - uint32 number of objective evaluations
+
+            A later version may append fields to the band record and must then raise
+            the record size. Readers skip the bytes they do not know, so any version
+            can read the version 1 fields. States without the chunk, or with a broken
+            one, are simply not restored. A chunk with no band records, with more
+            records than the reader accepts, or with a NaN/Inf time counts as broken.
+            Finite times are returned as stored; the caller clamps them to its range.
+        */
+        class OptimizerState
+        {
+        public:
+            static constexpr int maxBands = 8;
+            static constexpr int currentVersion = 1;
+
+            struct Band
+            {
+                float attack = 1.0f, release = 100.0f;
+                juce::uint32 numSearches = 0, numEvaluations = 0;
+            };
+
+            std::array<Band, maxBands> bands {};
+            int numBands = 0;
+
+            //==============================================================================
+            juce::String toBase64() const
+            {
+                juce::MemoryOutputStream stream;
+
+                stream.writeInt(magic);
+                stream.writeByte(static_cast<char>(currentVersion));
+                stream.writeByte(static_cast<char>(bandRecordSize));
+                stream.writeByte(static_cast<char>(numBands));
+
+                for (int i = 0; i < numBands; ++i)
+                {
+                    const auto& band = bands[static_cast<size_t>(i)];
+                    stream.writeFloat(band.attack);
+                    stream.writeFloat(band.release);
+                    stream.writeInt(static_cast<int>(band.numSearches));
+                    stream.writeInt(static_cast<int>(band.numEvaluations));
+                }
+
+                return stream.getMemoryBlock().toBase64Encoding();
+            }
+
+            /** Reads a chunk written by toBase64(). Returns false, leaving this object
+                unchanged, if the text is not a valid chunk or holds more than
+                maximumNumBands records.
+            */
+            bool fromBase64(const juce::String& text, int maximumNumBands = maxBands)
+            {
+                juce::MemoryBlock data;
+
+                if (! data.fromBase64Encoding(text) || data.getSize() < headerSize)
+                    return false;
+
+                juce::MemoryInputStream stream(data, false);
+
+                if (stream.readInt() != magic)
+                    return false;
+
+                const auto version = static_cast<juce::uint8>(stream.readByte());
+                const auto recordSize = static_cast<juce::uint8>(stream.readByte());
+                const auto numRecords = static_cast<juce::uint8>(stream.readByte());
+
+                if (version < 1 || recordSize < bandRecordSize
+                    || numRecords < 1 || numRecords > juce::jmin(maximumNumBands, maxBands)
+                    || data.getSize() < headerSize + static_cast<size_t>(recordSize) * numRecords)
+                    return false;
+
+                std::array<Band, maxBands> records {};
+
+                for (int i = 0; i < numRecords; ++i)
+                {
+                    auto& band = records[static_cast<size_t>(i)];
+                    band.attack = stream.readFloat();
+                    band.release = stream.readFloat();
+                    band.numSearches = static_cast<juce::uint32>(stream.readInt());
+                    band.numEvaluations = static_cast<juce::uint32>(stream.readInt());
+
+                    // A NaN/Inf would poison the ballistics filter and the search bracket
+                    if (! std::isfinite(band.attack) || ! std::isfinite(band.release))
+                        return false;
+
+                    stream.skipNextBytes(recordSize - bandRecordSize);
+                }
+
+                bands = records;
+                numBands = numRecords;
+                return true;
+            }
+
+        private:
+            //==============================================================================
+            static constexpr int magic = 0x706f4c48; // "HLop"
+            static constexpr size_t headerSize = 7;
+            static constexpr int bandRecordSize = 16;
+        };
+
+} // namespace dsp_original
@@ -0,0 +1,225 @@
+/*
+  ==============================================================================
+
+    ParameterPredictor.h
+    Attack/release prediction from cheap block features, learned online.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+
+namespace dsp_original
+{
+
+        /**
+            Predicts the attack and release times the search would find, from a few
+            features of the block:
+
+            - crest factor in dB;
+            - spectral tilt, as the energy of the first difference relative to the
+              signal energy in dB;
+            - transient density, in onsets per second;
+            - threshold;
+            - ratio.
+
+            Each feature is quantised to a few levels. Together they select a cell of
+            a fixed table that holds the average log-times of the search results seen
+            in that cell. The table is learned online, from full searches only: a
+            search narrowed around a prediction mostly returns that prediction, so
+            learning from it would only reinforce the table's own guesses. Once a
+            cell has seen a result, the search can start from its prediction with a
+            small budget.
+
+            Everything is preallocated. analyse() costs one pass over the block, and
+            predict() and learn() cost O(1).
+        */
+        class ParameterPredictor
+        {
+        public:
+            struct Features
+            {
+                float crestFactor = 0.0f, spectralTilt = 0.0f, transientDensity = 0.0f, threshold = 0.0f, ratio = 1.0f;
+            };
+
+            static constexpr int maxChannels = 2;
+            static constexpr int numCrestLevels = 4, numTiltLevels = 4, numTransientLevels = 3, numThresholdLevels = 3, numRatioLevels = 3;
+            static constexpr int numCells = numCrestLevels * numTiltLevels * numTransientLevels * numThresholdLevels * numRatioLevels;
+
+            ParameterPredictor() = default;
+
+            //==============================================================================
+            /** Sets the envelope coefficients of the onset detector. */
+            void prepare(double newSampleRate) noexcept
+            {
+                sampleRate = newSampleRate;
+                fastRelease = static_cast<float>(std::exp(-1.0 / (0.005 * sampleRate)));
+                slowCoefficient = static_cast<float>(std::exp(-1.0 / (0.1 * sampleRate)));
+                reset();
+            }
+
+            /** Clears the detector state, but keeps what has been learned. */
+            void reset() noexcept
+            {
+                previousSample.fill(0.0f);
+                fastEnvelope = slowEnvelope = 0.0f;
+                onsetActive = false;
+                features = {};
+            }
+
+            /** Forgets everything learned. */
+            void clearTable() noexcept
+            {
+                table.fill({});
+            }
+
+            //==============================================================================
+            /** Measures the features of a block and returns them. */
+            const Features& analyse(const juce::dsp::AudioBlock<const float>& block, float threshold, float ratio) noexcept
+            {
+                const auto numChannels = juce::jmin(block.getNumChannels(), static_cast<size_t>(maxChannels));
+                const auto numSamples = block.getNumSamples();
+                auto peak = 0.0f, energy = 0.0f, differenceEnergy = 0.0f;
+                auto numOnsets = 0;
+
+                std::array<const float*, maxChannels> samples {};
+                for (size_t channel = 0; channel < numChannels; ++channel)
+                    samples[channel] = block.getChannelPointer(channel);
+
+                for (size_t i = 0; i < numSamples; ++i)
+                {
+                    auto level = 0.0f;
+
+                    for (size_t channel = 0; channel < numChannels; ++channel)
+                    {
+                        const auto x = samples[channel][i];
+                        const auto difference = x - previousSample[channel];
+                        previousSample[channel] = x;
+
+                        energy += x * x;
+                        differenceEnergy += difference * difference;
+                        level = juce::jmax(level, std::abs(x));
+                    }
+
+                    peak = juce::jmax(peak, level);
+
+                    // a peak envelope and its 100 ms average; an onset is the peak jumping above twice the average
+                    fastEnvelope = juce::jmax(level, fastEnvelope * fastRelease);
+                    slowEnvelope = fastEnvelope + (slowEnvelope - fastEnvelope) * slowCoefficient;
+
+                    if (! onsetActive && fastEnvelope > 2.0f * slowEnvelope + onsetFloor)
+                    {
+                        onsetActive = true;
+                        ++numOnsets;
+                    }
+                    else if (onsetActive && fastEnvelope < 1.25f * slowEnvelope)
+                    {
+                        onsetActive = false;
+                    }
+                }
+
+                const auto meanSquare = energy / static_cast<float>(juce::jmax(size_t { 1 }, numSamples * numChannels));
+                const auto blockDuration = static_cast<float>(static_cast<double>(numSamples) / sampleRate);
+
+                features.crestFactor = meanSquare > 0.0f ? juce::Decibels::gainToDecibels(peak / std::sqrt(meanSquare)) : 0.0f;
+                features.spectralTilt = 10.0f * std::log10((differenceEnergy + 1.0e-12f) / (energy + 1.0e-12f));
+
+                // onset rate, smoothed over about a second
+                if (blockDuration > 0.0f)
+                    features.transientDensity += (numOnsets / blockDuration - features.transientDensity) * juce::jmin(1.0f, blockDuration);
+
+                features.threshold = threshold;
+                features.ratio = ratio;
+
+                return features;
+            }
+
+            /** Writes the prediction for the cell of the features and returns true,
+                or returns false if that cell has not learned anything yet.
+            */
+            bool predict(const Features& f, double& attack, double& release) const noexcept
+            {
+                const auto& cell = table[static_cast<size_t>(getCellIndex(f))];
+
+                if (cell.count == 0)
+                    return false;
+
+                attack = std::exp(static_cast<double>(cell.logAttack)) - 1.0;
+                release = std::exp(static_cast<double>(cell.logRelease)) - 1.0;
+                return true;
+            }
+
+            /** Adds a search result to the cell of the features: a running mean at first,
+                then an exponential average, so the table keeps following the material.
+            */
+            void learn(const Features& f, double attack, double release) noexcept
+            {
+                auto& cell = table[static_cast<size_t>(getCellIndex(f))];
+                const auto weight = juce::jmax(learningRate, 1.0f / static_cast<float>(cell.count + 1));
+
+                cell.logAttack += (static_cast<float>(std::log1p(juce::jmax(0.0, attack))) - cell.logAttack) * weight;
+                cell.logRelease += (static_cast<float>(std::log1p(juce::jmax(0.0, release))) - cell.logRelease) * weight;
+                cell.count = juce::jmin(cell.count + 1, 1 << 30);
+            }
+
+            /** Returns how many cells have learned at least one result. */
+            int getNumTrainedCells() const noexcept
+            {
+                auto result = 0;
+
+                for (const auto& cell : table)
+                    result += cell.count > 0 ? 1 : 0;
+
+                return result;
+            }
+
+        private:
+            //==============================================================================
+            struct Cell
+            {
+                float logAttack = 0.0f, logRelease = 0.0f;
+                int count = 0;
+            };
+
+            template <size_t numEdges>
+            static int quantise(float value, const std::array<float, numEdges>& edges) noexcept
+            {
+                auto level = 0;
+
+                for (auto edge : edges)
+                    level += value >= edge ? 1 : 0;
+
+                return level;
+            }
+
+            static int getCellIndex(const Features& f) noexcept
+            {
+                auto index = quantise(f.crestFactor, std::array<float, numCrestLevels - 1> { 6.0f, 10.0f, 15.0f });
+                index = index * numTiltLevels + quantise(f.spectralTilt, std::array<float, numTiltLevels - 1> { -20.0f, -10.0f, -3.0f });
+                index = index * numTransientLevels + quantise(f.transientDensity, std::array<float, numTransientLevels - 1> { 1.0f, 4.0f });
+                index = index * numThresholdLevels + quantise(f.threshold, std::array<float, numThresholdLevels - 1> { -20.0f, -6.0f });
+                index = index * numRatioLevels + quantise(f.ratio, std::array<float, numRatioLevels - 1> { 3.0f, 10.0f });
+                return index;
+            }
+
+            //==============================================================================
+            static constexpr float learningRate = 0.05f;
+            static constexpr float onsetFloor = 1.0e-4f; // about -80 dBFS
+
+            double sampleRate = 44100.0;
+            float fastRelease = 0.0f, slowCoefficient = 0.0f;
+            float fastEnvelope = 0.0f, slowEnvelope = 0.0f;
+            bool onsetActive = false;
+            std::array<float, maxChannels> previousSample {};
+            Features features;
+
+            std::array<Cell, numCells> table {};
+
+            JUCE_DECLARE_NON_COPYABLE(ParameterPredictor)
+        };
+
+} // namespace dsp_original
@@ -11,15 +11,156 @@
 
 //==============================================================================
 HeuristicLimiterAudioProcessorEditor::HeuristicLimiterAudioProcessorEditor (HeuristicLimiterAudioProcessor& p)
-    : AudioProcessorEditor (&p), audioProcessor (p)
+    : AudioProcessorEditor (&p), audioProcessor (p),
+      gainAttachment(*p.gain, gainSlider),
+      thresholdAttachment(*p.threshold, thresholdSlider),
+      ratioAttachment(*p.ratio, ratioSlider),
+      kneeAttachment(*p.knee, kneeSlider),
+      numBandsAttachment(*p.numBands, numBandsSlider),
+      sidechainHighPassAttachment(*p.sidechainHighPass, sidechainHighPassSlider),
+      lowLatencyAttachment(*p.lowLatency, lowLatencyButton),
+      controlRateAttachment(*p.controlRate, controlRateButton),
+      predictorAttachment(*p.predictorMode, predictorButton),
+      stereoLinkAttachment(*p.stereoLink, stereoLinkButton),
+      limiterAttachment(*p.limiter, limiterButton),
+      modeAttachment(*p.mode, modeBox)
 {
+    setUpSlider(gainSlider, gainLabel, "Gain");
+    setUpSlider(thresholdSlider, thresholdLabel, "Threshold");
+    setUpSlider(ratioSlider, ratioLabel, "Ratio");
+    setUpSlider(kneeSlider, kneeLabel, "Knee");
+    setUpSlider(numBandsSlider, numBandsLabel, "Bands");
+    setUpSlider(sidechainHighPassSlider, sidechainHighPassLabel, "SC HPF");
+
+    for (auto* button : { &limiterButton, &lowLatencyButton, &controlRateButton, &predictorButton, &stereoLinkButton })
+        addAndMakeVisible(*button);
+
+    // アタッチメントは項目の並び順で選択するので、パラメータと同じ順に並べる
+    modeBox.addItemList(p.mode->choices, 1);
+    addAndMakeVisible(modeBox);
+
+    setOpaque(true);
+
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (400, 300);
+    setSize (640, 420);
+
+    // エディタが開く前に溜まったフレームは古いので捨てる（履歴には載せない）
+    audioProcessor.getMeterQueue().popAll([](const HeuristicLimiterAudioProcessor::MeterFrame&) {});
+    startTimerHz(REFRESH_RATE);
 }
 
 HeuristicLimiterAudioProcessorEditor::~HeuristicLimiterAudioProcessorEditor()
 {
+    stopTimer();
+}
+
+void HeuristicLimiterAudioProcessorEditor::setUpSlider(juce::Slider& slider, juce::Label& label, const juce::String& name)
+{
+    slider.setSliderStyle(juce::Slider::RotaryHorizontalVerticalDrag);
+    slider.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 80, 20);
+    addAndMakeVisible(slider);
+
+    label.setText(name, juce::dontSendNotification);
+    label.setJustificationType(juce::Justification::centred);
+    label.attachToComponent(&slider, false);
+}
+
+//==============================================================================
+void HeuristicLimiterAudioProcessorEditor::timerCallback()
+{
+    // キューに溜まった値を一点にまとめる（ピークは最大、リダクションは最大の減衰）
+    auto inputPeak = 0.0f, outputPeak = 0.0f;
+    HistoryPoint point;
+    auto newLoudness = loudness;
+    auto hasNewFrames = false;
+
+    audioProcessor.getMeterQueue().popAll([&](const HeuristicLimiterAudioProcessor::MeterFrame& frame) {
+        inputPeak = juce::jmax(inputPeak, frame.inputPeak);
+        outputPeak = juce::jmax(outputPeak, frame.outputPeak);
+        point.gainReduction = juce::jmax(point.gainReduction, frame.gainReduction);
+        point.attack = frame.attack;
+        point.release = frame.release;
+        newLoudness = frame.loudness; // メーター側で平均済みなので最後の値
+        hasNewFrames = true;
+    });
+
+    // メーターは新しい値か、一定の速さで落ちた値の大きい方
+    const auto decay = METER_DECAY / static_cast<float>(REFRESH_RATE);
+    const auto previousLevels = std::array<float, 3> { inputLevel, outputLevel, gainReduction };
+
+    inputLevel = juce::jmax(juce::Decibels::gainToDecibels(inputPeak, -LEVEL_RANGE), inputLevel - decay);
+    outputLevel = juce::jmax(juce::Decibels::gainToDecibels(outputPeak, -LEVEL_RANGE), outputLevel - decay);
+    gainReduction = juce::jmax(point.gainReduction, gainReduction - decay, 0.0f);
+
+    if (hasNewFrames)
+    {
+        history[static_cast<size_t>(historyPosition)] = point;
+        historyPosition = (historyPosition + 1) % HISTORY_SIZE;
+
+        updatePaths();
+        repaint(historyArea);
+    }
+
+    // 変化した領域だけ描き直す（ノブなどは再描画しない）
+    if (previousLevels != std::array<float, 3> { inputLevel, outputLevel, gainReduction })
+        repaint(meterArea);
+
+    // 表示桁（0.1 LU）で変わった時だけ
+    const auto toDisplayed = [](const dsp_original::LoudnessMeter::Report& report) {
+        return std::array<int, 3> { juce::roundToInt(report.momentary * 10.0f), juce::roundToInt(report.shortTerm * 10.0f),
+                                    juce::roundToInt(report.integrated * 10.0f) };
+    };
+
+    if (toDisplayed(newLoudness) != toDisplayed(loudness))
+    {
+        loudness = newLoudness;
+        repaint(loudnessArea);
+    }
+}
+
+void HeuristicLimiterAudioProcessorEditor::updatePaths()
+{
+    gainReductionPath.clear();
+    attackPath.clear();
+    releasePath.clear();
+
+    if (historyArea.isEmpty())
+        return;
+
+    const auto area = historyArea.toFloat();
+    const auto step = area.getWidth() / static_cast<float>(HISTORY_SIZE - 1);
+
+    // リダクションは上から下へ、アタック・リリースは対数目盛りで下から上へ
+    const auto maximumAttack = std::log1p(static_cast<float>(HeuristicLimiterAudioProcessor::MAXIMUM_ATTACK_TIME));
+    const auto maximumRelease = std::log1p(static_cast<float>(HeuristicLimiterAudioProcessor::MAXIMUM_RELEASE_TIME));
+    const auto toReductionY = [&](float dB) { return area.getY() + juce::jlimit(0.0f, 1.0f, dB / GAIN_REDUCTION_RANGE) * area.getHeight(); };
+    const auto toTimeY = [&](float ms, float maximum) { return area.getBottom() - juce::jlimit(0.0f, 1.0f, std::log1p(ms) / maximum) * area.getHeight(); };
+
+    gainReductionPath.startNewSubPath(area.getX(), area.getY());
+
+    for (int i = 0; i < HISTORY_SIZE; ++i)
+    {
+        // 古い点から順に
+        const auto& point = history[static_cast<size_t>((historyPosition + i) % HISTORY_SIZE)];
+        const auto x = area.getX() + step * static_cast<float>(i);
+
+        gainReductionPath.lineTo(x, toReductionY(point.gainReduction));
+
+        if (i == 0)
+        {
+            attackPath.startNewSubPath(x, toTimeY(point.attack, maximumAttack));
+            releasePath.startNewSubPath(x, toTimeY(point.release, maximumRelease));
+        }
+        else
+        {
+            attackPath.lineTo(x, toTimeY(point.attack, maximumAttack));
+            releasePath.lineTo(x, toTimeY(point.release, maximumRelease));
+        }
+    }
+
+    gainReductionPath.lineTo(area.getRight(), area.getY());
+    gainReductionPath.closeSubPath();
 }
 
 //==============================================================================
@@ -28,13 +169,129 @@ void HeuristicLimiterAudioProcessorEditor::paint (juce::Graphics& g)
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
 
-    g.setColour (juce::Colours::white);
-    g.setFont (15.0f);
-    g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
+    // 履歴（パスはタイマーで作り直したものを描くだけ）
+    g.setColour(juce::Colours::black);
+    g.fillRect(historyArea);
+
+    g.setColour(juce::Colours::red.withAlpha(0.6f));
+    g.fillPath(gainReductionPath);
+    g.setColour(juce::Colours::orange);
+    g.strokePath(attackPath, juce::PathStrokeType(1.5f));
+    g.setColour(juce::Colours::skyblue);
+    g.strokePath(releasePath, juce::PathStrokeType(1.5f));
+
+    const auto& latest = history[static_cast<size_t>((historyPosition + HISTORY_SIZE - 1) % HISTORY_SIZE)];
+    auto legend = historyArea.reduced(6, 4).removeFromBottom(16);
+
+    g.setFont(13.0f);
+    g.setColour(juce::Colours::orange);
+    g.drawText("Attack " + juce::String(latest.attack, 2) + " ms", legend.removeFromLeft(140), juce::Justification::centredLeft);
+    g.setColour(juce::Colours::skyblue);
+    g.drawText("Release " + juce::String(latest.release, 1) + " ms", legend.removeFromLeft(160), juce::Justification::centredLeft);
+    g.setColour(juce::Colours::red);
+    g.drawText("Gain reduction (0 to -" + juce::String(static_cast<int>(GAIN_REDUCTION_RANGE)) + " dB)", legend, juce::Justification::centredRight);
+
+    g.setColour(juce::Colours::grey);
+    g.drawRect(historyArea);
+
+    paintMeters(g);
+    paintLoudness(g);
+}
+
+void HeuristicLimiterAudioProcessorEditor::paintMeters(juce::Graphics& g) const
+{
+    // 入力ピーク・出力ピーク（dBFS）とゲインリダクションのバー
+    struct Meter
+    {
+        const char* name;
+        float proportion, value;
+        juce::Colour colour;
+        bool fromTop;
+    };
+    const std::array<Meter, 3> meters {{
+        { "In", 1.0f + inputLevel / LEVEL_RANGE, inputLevel, juce::Colours::lightgreen, false },
+        { "Out", 1.0f + outputLevel / LEVEL_RANGE, outputLevel, juce::Colours::lightgreen, false },
+        { "GR", gainReduction / GAIN_REDUCTION_RANGE, -gainReduction, juce::Colours::red, true }
+    }};
+
+    auto area = meterArea;
+    const auto columnWidth = area.getWidth() / static_cast<int>(meters.size());
+
+    g.setFont(12.0f);
+
+    for (const auto& meter : meters)
+    {
+        auto column = area.removeFromLeft(columnWidth).reduced(4, 0);
+        const auto nameArea = column.removeFromTop(16);
+        const auto valueArea = column.removeFromBottom(16);
+
+        g.setColour(juce::Colours::white);
+        g.drawText(meter.name, nameArea, juce::Justification::centred);
+        g.drawText(juce::String(meter.value, 1), valueArea, juce::Justification::centred);
+
+        g.setColour(juce::Colours::black);
+        g.fillRect(column);
+
+        const auto bar = column.toFloat();
+        const auto height = bar.getHeight() * juce::jlimit(0.0f, 1.0f, meter.proportion);
+
+        g.setColour(meter.colour);
+        g.fillRect(juce::Rectangle<float>(bar.getX(), meter.fromTop ? bar.getY() : bar.getBottom() - height, bar.getWidth(), height));
+
+        g.setColour(juce::Colours::grey);
+        g.drawRect(column);
+    }
+}
+
+void HeuristicLimiterAudioProcessorEditor::paintLoudness(juce::Graphics& g) const
+{
+    // 出力のラウドネス（LUFS、ゲート前の無音は "-"）
+    const std::array<std::pair<const char*, float>, 3> values {{
+        { "M", loudness.momentary }, { "S", loudness.shortTerm }, { "I", loudness.integrated }
+    }};
+
+    auto area = loudnessArea.reduced(4, 0);
+    const auto rowHeight = area.getHeight() / static_cast<int>(values.size() + 1);
+
+    g.setFont(12.0f);
+    g.setColour(juce::Colours::white);
+    g.drawText("LUFS", area.removeFromTop(rowHeight), juce::Justification::centred);
+
+    for (const auto& [name, value] : values)
+    {
+        auto row = area.removeFromTop(rowHeight);
+        g.drawText(name, row.removeFromLeft(20), juce::Justification::centredLeft);
+        g.drawText(value > dsp_original::LoudnessMeter::silence ? juce::String(value, 1) : juce::String("-"),
+                   row, juce::Justification::centredRight);
+    }
 }
 
 void HeuristicLimiterAudioProcessorEditor::resized()
 {
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
+    auto area = getLocalBounds().reduced(10);
+
+    // 上段：ノブ（ラベルは上に付く）
+    auto knobs = area.removeFromTop(120);
+    knobs.removeFromTop(20);
+    const auto knobWidth = knobs.getWidth() / 6;
+    for (auto* slider : { &gainSlider, &thresholdSlider, &ratioSlider, &kneeSlider, &numBandsSlider, &sidechainHighPassSlider })
+        slider->setBounds(knobs.removeFromLeft(knobWidth));
+
+    // 中段：切り替え
+    auto switches = area.removeFromTop(30);
+    modeBox.setBounds(switches.removeFromLeft(140).reduced(0, 3));
+    switches.removeFromLeft(10);
+    const auto buttonWidth = switches.getWidth() / 5;
+    for (auto* button : { &limiterButton, &lowLatencyButton, &controlRateButton, &predictorButton, &stereoLinkButton })
+        button->setBounds(switches.removeFromLeft(buttonWidth));
+
+    // 下段：履歴とメーター
+    area.removeFromTop(10);
+    meterArea = area.removeFromRight(120);
+    loudnessArea = meterArea.removeFromBottom(72);
+    meterArea.removeFromBottom(6);
+    area.removeFromRight(10);
+    historyArea = area;
+
+    updatePaths();
 }
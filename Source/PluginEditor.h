@@ -13,8 +13,16 @@
 
 //==============================================================================
 /**
+    Controls for every parameter, plus peak and gain reduction meters, a loudness
+    readout and a history of the gain reduction and of the attack/release chosen
+    by the search.
+
+    The audio thread only pushes meter frames into a lock-free queue. A 30 Hz
+    timer on the message thread drains it, rebuilds the cached history paths
+    and repaints only when something changed.
 */
-class HeuristicLimiterAudioProcessorEditor  : public juce::AudioProcessorEditor
+class HeuristicLimiterAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                              private juce::Timer
 {
 public:
     HeuristicLimiterAudioProcessorEditor (HeuristicLimiterAudioProcessor&);
@@ -25,9 +33,48 @@ public:
     void resized() override;
 
 private:
+    void timerCallback() override;
+
+    // 履歴のパスを作り直す（新しい値が来た時とリサイズ時のみ）
+    void updatePaths();
+    void paintMeters(juce::Graphics& g) const;
+    void paintLoudness(juce::Graphics& g) const;
+    void setUpSlider(juce::Slider& slider, juce::Label& label, const juce::String& name);
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     HeuristicLimiterAudioProcessor& audioProcessor;
 
+    constexpr static int REFRESH_RATE = 30;                 // Hz
+    constexpr static int HISTORY_SIZE = 10 * REFRESH_RATE;  // 10秒分
+    constexpr static float GAIN_REDUCTION_RANGE = 24.0f, LEVEL_RANGE = 48.0f; // dB
+    constexpr static float METER_DECAY = 20.0f;             // dB/s（値が来ない間の落ち方）
+
+    // 表示間隔毎に一点（古いものから上書き）
+    struct HistoryPoint
+    {
+        float gainReduction = 0.0f, attack = 0.0f, release = 0.0f;
+    };
+    std::array<HistoryPoint, HISTORY_SIZE> history {};
+    int historyPosition = 0;
+    float inputLevel = -LEVEL_RANGE, outputLevel = -LEVEL_RANGE, gainReduction = 0.0f; // dB
+    dsp_original::LoudnessMeter::Report loudness; // 最後のフレームの値
+
+    juce::Path gainReductionPath, attackPath, releasePath;
+    juce::Rectangle<int> historyArea, meterArea, loudnessArea;
+
+    // controls
+    juce::Slider gainSlider, thresholdSlider, ratioSlider, kneeSlider, numBandsSlider, sidechainHighPassSlider;
+    juce::Label gainLabel, thresholdLabel, ratioLabel, kneeLabel, numBandsLabel, sidechainHighPassLabel;
+    juce::ToggleButton lowLatencyButton { "Low latency" }, controlRateButton { "Control rate" },
+                       predictorButton { "Predictor" }, stereoLinkButton { "Stereo link" }, limiterButton { "Limiter (inf:1)" };
+    juce::ComboBox modeBox;
+
+    // 操作部品の後に宣言する（先に破棄される）
+    juce::SliderParameterAttachment gainAttachment, thresholdAttachment, ratioAttachment, kneeAttachment, numBandsAttachment,
+                                    sidechainHighPassAttachment;
+    juce::ButtonParameterAttachment lowLatencyAttachment, controlRateAttachment, predictorAttachment, stereoLinkAttachment, limiterAttachment;
+    juce::ComboBoxParameterAttachment modeAttachment;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HeuristicLimiterAudioProcessorEditor)
 };
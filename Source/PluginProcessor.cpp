@@ -6,10 +6,77 @@
   ==============================================================================
 */
 
+#include <cstdlib>
+#include <numeric>
+#include <utility>
 #include <boost/math/tools/minima.hpp>
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+#if HEURISTICLIMITER_ALLOCATION_GUARD
+//==============================================================================
+// オーディオスレッド上の確保を検出するための置き換え
+void* operator new (std::size_t size)
+{
+    dsp_original::AllocationGuard::allocationMade();
+
+    if (auto* ptr = std::malloc(size > 0 ? size : 1))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size)
+{
+    return operator new (size);
+}
+
+void operator delete (void* ptr) noexcept             { std::free(ptr); }
+void operator delete[] (void* ptr) noexcept           { std::free(ptr); }
+void operator delete (void* ptr, std::size_t) noexcept   { std::free(ptr); }
+void operator delete[] (void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+ #if __cpp_aligned_new
+  #if JUCE_WINDOWS
+   #include <malloc.h>
+  #endif
+
+// alignas付きの型（SIMD用の構造体など）はこちらを通る
+void* operator new (std::size_t size, std::align_val_t alignment)
+{
+    dsp_original::AllocationGuard::allocationMade();
+
+    const auto align = juce::jmax(static_cast<std::size_t>(alignment), sizeof(void*));
+  #if JUCE_WINDOWS
+    if (auto* ptr = _aligned_malloc(size > 0 ? size : 1, align))
+        return ptr;
+  #else
+    if (void* ptr = nullptr; posix_memalign(&ptr, align, size > 0 ? size : 1) == 0)
+        return ptr;
+  #endif
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size, std::align_val_t alignment)
+{
+    return operator new (size, alignment);
+}
+
+  #if JUCE_WINDOWS
+void operator delete (void* ptr, std::align_val_t) noexcept                 { _aligned_free(ptr); }
+void operator delete[] (void* ptr, std::align_val_t) noexcept               { _aligned_free(ptr); }
+void operator delete (void* ptr, std::size_t, std::align_val_t) noexcept    { _aligned_free(ptr); }
+void operator delete[] (void* ptr, std::size_t, std::align_val_t) noexcept  { _aligned_free(ptr); }
+  #else
+void operator delete (void* ptr, std::align_val_t) noexcept                 { std::free(ptr); }
+void operator delete[] (void* ptr, std::align_val_t) noexcept               { std::free(ptr); }
+void operator delete (void* ptr, std::size_t, std::align_val_t) noexcept    { std::free(ptr); }
+void operator delete[] (void* ptr, std::size_t, std::align_val_t) noexcept  { std::free(ptr); }
+  #endif
+ #endif
+#endif
+
 //==============================================================================
 HeuristicLimiterAudioProcessor::HeuristicLimiterAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -17,30 +84,61 @@ HeuristicLimiterAudioProcessor::HeuristicLimiterAudioProcessor()
                      #if ! JucePlugin_IsMidiEffect
                       #if ! JucePlugin_IsSynth
                        .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
+                       .withInput  ("Sidechain", juce::AudioChannelSet::stereo(), false)
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
-                       )
+                       ),
+#else
+    :
 #endif
-    : gain(new juce::AudioParameterFloat("GAIN", "Gain", 0.0f, 20.0f, 0.0f))
+      gain(new juce::AudioParameterFloat("GAIN", "Gain", 0.0f, 20.0f, 0.0f))
     , threshold(new juce::AudioParameterFloat("THRESHOLD", "Threshold", -50.0f, 0.0f, -0.3f))
     , ratio(new juce::AudioParameterFloat("RATIO", "Ratio", 1.0f, 20.0f, 4.0f))
+    , knee(new juce::AudioParameterFloat("KNEE", "Knee", 0.0f, 24.0f, 0.0f))
+    , sidechainHighPass(new juce::AudioParameterFloat("SIDECHAIN_HPF", "Sidechain HPF", 20.0f, 500.0f, 20.0f))
+    , lowLatency(new juce::AudioParameterBool("LOW_LATENCY", "Low Latency", false))
+    , controlRate(new juce::AudioParameterBool("CONTROL_RATE", "Control-Rate Gain", false))
+    , predictorMode(new juce::AudioParameterBool("PREDICTOR", "Predictor", false))
+    , stereoLink(new juce::AudioParameterBool("LINK", "Stereo Link", false))
+    , limiter(new juce::AudioParameterBool("LIMITER", "Limiter (Ratio Infinite)", false))
+    , numBands(new juce::AudioParameterInt("BANDS", "Bands", 1, MAX_BANDS, 1))
+    , mode(new juce::AudioParameterChoice("MODE", "Mode", juce::StringArray { "Auto", "Eco", "Realtime", "High Quality" }, 0))
     , oversampling(1, OVERSAMPLE_FACTOR, juce::dsp::Oversampling<float>::filterHalfBandFIREquiripple)
-    , fft(12)
+    , oversamplingLowLatency(1, OVERSAMPLE_FACTOR, juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR, false)
+    , oversamplingEco(1, OVERSAMPLE_FACTOR_ECO, juce::dsp::Oversampling<float>::filterHalfBandFIREquiripple)
+    , oversamplingEcoLowLatency(1, OVERSAMPLE_FACTOR_ECO, juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR, false)
 {
-    for (auto i : {gain, threshold, ratio}) {
+    for (auto i : {gain, threshold, ratio, knee}) {
       addParameter(i);
     }
+    for (auto i : {lowLatency, controlRate}) {
+      addParameter(i);
+    }
+    addParameter(numBands);
+    addParameter(predictorMode);
+    addParameter(mode);
+    addParameter(stereoLink);
+    addParameter(sidechainHighPass);
+    addParameter(limiter); // 既存のパラメータの番号を変えないよう最後に追加
   
-    // prepare DSPs
-	processorChain.get<compressorIndex>().setLookAheadTime(LOOKAHEAD_TIME); // Set the look-ahead time in milliseconds
-    processorChain.get<waveShaperIndex>().functionToUse = [](float x) {
-        return std::tanh(x);
-    };
+    // prepare DSPs（全バンド分をここで確保しておく）
+    for (auto& band : bands) {
+        band = std::make_unique<Band>();
+        band->compressor.setMaximumLookAheadTime(LOOKAHEAD_TIME);
+        band->compressor.setLookAheadTime(LOOKAHEAD_TIME); // Set the look-ahead time in milliseconds
+        band->simulator.setMaximumLookAheadTime(LOOKAHEAD_TIME);
+        band->simulator.setLookAheadTime(LOOKAHEAD_TIME);
+    }
+    trajectoryOptimizer.setMaximumLookAheadTime(LOOKAHEAD_TIME);
+    trajectoryOptimizer.setLookAheadTime(LOOKAHEAD_TIME);
+
+    startTimerHz(LATENCY_CHECK_RATE);
 }
 
 HeuristicLimiterAudioProcessor::~HeuristicLimiterAudioProcessor()
 {
+    stopTimer();
 }
 
 //==============================================================================
@@ -110,29 +208,65 @@ void HeuristicLimiterAudioProcessor::prepareToPlay (double sampleRate, int sampl
 {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
+    // 検出とルックアヘッドはベースレートで行う（オーバーサンプルするのはゲイン適用とソフトクリップのみ）
     juce::dsp::ProcessSpec a;
-    a.sampleRate = sampleRate * OVERSAMPLE_RATIO;
-    a.maximumBlockSize = samplesPerBlock * OVERSAMPLE_RATIO;
+    a.sampleRate = sampleRate;
+    a.maximumBlockSize = samplesPerBlock;
     a.numChannels = getTotalNumOutputChannels();
   
-    processorChain.reset();
-    processorChain.prepare(a);
-
-    // reset oversampler
-    oversampling.reset();
-    oversampling.numChannels = getTotalNumOutputChannels();
-    oversampling.initProcessing(samplesPerBlock);
+    for (auto& band : bands)
+        band->compressor.prepare(a);
+
+    ceiling.prepare(a);
+    crossover.prepare(a);
+
+    // サイドチェーンのチャンネル数はメインと異なることがある
+    sidechainFilter.setType(juce::dsp::LinkwitzRileyFilterType::highpass);
+    sidechainFilter.prepare({ sampleRate, static_cast<juce::uint32>(samplesPerBlock), static_cast<juce::uint32>(MAX_CHANNELS) });
+    sidechainFilterActive = false;
+
+    // reset oversampler（両モード分を用意しておく）
+    for (auto* o : {&oversampling, &oversamplingLowLatency, &oversamplingEco, &oversamplingEcoLowLatency}) {
+        o->reset();
+        o->numChannels = getTotalNumOutputChannels();
+        o->initProcessing(samplesPerBlock);
+    }
 
     // adjust latency
-    setLatencySamples(static_cast<int>(oversampling.getLatencyInSamples()) + processorChain.get<compressorIndex>().getLatencyInSamples());
-    
-    // FFT・バッファ初期化
-    const auto order = static_cast<int>(std::ceil(std::log2(samplesPerBlock)));
-    fft = juce::dsp::FFT(order);
-    fftBuffer = std::vector(getTotalNumInputChannels(), std::vector(fft.getSize() * 2, 0.0f));
+    setProcessingMode(getRequestedProcessingMode());
+    setNumBands(*numBands);
+    setLowLatencyMode(*lowLatency);
+    latencyChanged = false;
+    setLatencySamples(getTotalLatencyInSamples());
+
+    // 超過はスレッショルドではなく0dBTPに対して数える（レシオ・ニーによってはスレッショルドを超えるのが正常）
+    truePeakMeter.setCeiling(1.0f);
+    truePeakMeter.reset();
+    callbackStatistics.reset();
+    pinnedSearchPosition = 0;
+    meterAccumulator = {};
+    meterNumSamples = 0;
+    meterIntervalSamples = juce::jmax(1, static_cast<int>(sampleRate * METER_INTERVAL_TIME / 1000.0));
+    loudnessMeter.prepare(sampleRate, getTotalNumOutputChannels());
     
-    temporaryResultBuffer.setSize(getTotalNumOutputChannels(), fft.getSize() * 2);
-	temporaryResultBuffer2.setSize(getTotalNumOutputChannels(), samplesPerBlock);
+    // シミュレーションは本番と同じベースレートのspecで準備する（作業領域は一つのアリーナから切り出す）
+    maximumBlockSize = samplesPerBlock;
+    const auto bandBufferBytes = dsp_original::ScratchArena::getRequiredBytes<float>(static_cast<size_t>(samplesPerBlock));
+    scratchArena.prepare(MAX_BANDS * (Simulator::getRequiredScratchBytes(sampleRate, samplesPerBlock) + MAX_CHANNELS * bandBufferBytes)
+                         + Trajectory::getRequiredScratchBytes(sampleRate, samplesPerBlock));
+
+    for (auto& band : bands) {
+        band->simulator.prepare(a, scratchArena);
+        band->predictor.prepare(sampleRate);
+
+        for (auto& channelBuffer : band->buffer)
+            channelBuffer = scratchArena.allocate<float>(static_cast<size_t>(samplesPerBlock));
+    }
+
+    trajectoryOptimizer.prepare(a, scratchArena);
+
+    // 探索は前回の動作点から再開する
+    warmStartPending = true;
 }
 
 void HeuristicLimiterAudioProcessor::releaseResources()
@@ -160,6 +294,15 @@ bool HeuristicLimiterAudioProcessor::isBusesLayoutSupported (const BusesLayout&
    #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
+
+    // サイドチェーンは無効・モノラル・ステレオのいずれか
+    if (layouts.inputBuses.size() > 1) {
+        const auto sidechain = layouts.getChannelSet(true, 1);
+        if (! sidechain.isDisabled()
+         && sidechain != juce::AudioChannelSet::mono()
+         && sidechain != juce::AudioChannelSet::stereo())
+            return false;
+    }
    #endif
 
     return true;
@@ -167,63 +310,311 @@ bool HeuristicLimiterAudioProcessor::isBusesLayoutSupported (const BusesLayout&
 }
 #endif
 
-// 誤差計測用の関数を返す
-template <bool Is_release>
-auto HeuristicLimiterAudioProcessor::getFuncCalculateDiff(
-    const juce::dsp::ProcessContextNonReplacing<float>& simulate,
-    int totalNumInputChannels,
-    const decltype(fftBuffer)& buffer)
+//==============================================================================
+void HeuristicLimiterAudioProcessor::setLowLatencyMode(bool shouldUseLowLatency) noexcept
 {
-    return [&, totalNumInputChannels](double param) -> double {
-		// FIXME: ここでのparamはRelease/Attack値を表すが、OVERSAMPLE_RATIOを考慮していないため、調整が必要
-        auto temporaryProcessorChain = processorChain;
+    lowLatencyActive = shouldUseLowLatency;
 
-        //juce::dsp::ProcessSpec a;
-        //a.sampleRate = this->getSampleRate();
-        //a.maximumBlockSize = simulate.getInputBlock().getNumSamples();
-        //a.numChannels = totalNumInputChannels;
+    // ルックアヘッドはprepare時に確保した範囲で切り替えるだけ（確保なし）
+    const auto lookAheadTime = static_cast<float>(shouldUseLowLatency ? LOOKAHEAD_TIME_LOW_LATENCY : LOOKAHEAD_TIME);
+    for (auto& band : bands) {
+        band->compressor.setLookAheadTime(lookAheadTime);
+        band->simulator.setLookAheadTime(lookAheadTime);
 
-        //temporaryProcessorChain.prepare(a);
+        // アップサンプラーの遅延分だけルックアヘッドの遅延を短くする（検出側の先読み量は変わらない）
+        band->compressor.setDelayCompensation(getDelayCompensationInSamples());
+    }
+    trajectoryOptimizer.setLookAheadTime(lookAheadTime);
 
-        // 仮のRelease/Attack値を試す
-        if constexpr (Is_release)
-            temporaryProcessorChain.get<compressorIndex>().setRelease(static_cast<float>(param / OVERSAMPLE_RATIO));
-        else
-            temporaryProcessorChain.get<compressorIndex>().setAttack(static_cast<float>(param / OVERSAMPLE_RATIO));
-        temporaryProcessorChain.process(simulate);
+    getOversampling().reset();
 
-        std::atomic<double> result = 0.0;
+    // ホストへのレイテンシー通知はメッセージスレッドで行う
+    latencyChanged = true;
+}
 
-        // 誤差を計算
-		#pragma omp parallel for
-        for (int channel = 0; channel < totalNumInputChannels; ++channel)
-        {
-            auto inBufferFrom = buffer[channel].begin();
-            auto* inBufferTo = temporaryResultBuffer.getWritePointer(channel);
-
-            // FFT（resultBufferを直接指定している点については暫定措置）
-            std::fill_n(inBufferTo + simulate.getInputBlock().getNumSamples(),
-                        fft.getSize() * 2 - simulate.getInputBlock().getNumSamples(),
-                        0.0f);
-            fft.performFrequencyOnlyForwardTransform(inBufferTo);
-            
-            for (auto samples = 0; samples < buffer[channel].size(); samples++) {
-                result += std::fabs(std::log((1.0f + *inBufferFrom++) / (1.0f + *inBufferTo++)));
-            }
-        }
+juce::dsp::Oversampling<float>& HeuristicLimiterAudioProcessor::getOversampling() noexcept
+{
+    return const_cast<juce::dsp::Oversampling<float>&>(std::as_const(*this).getOversampling());
+}
+
+const juce::dsp::Oversampling<float>& HeuristicLimiterAudioProcessor::getOversampling() const noexcept
+{
+    if (getModeSettings().reducedOversampling)
+        return lowLatencyActive ? oversamplingEcoLowLatency : oversamplingEco;
+
+    return lowLatencyActive ? oversamplingLowLatency : oversampling;
+}
+
+int HeuristicLimiterAudioProcessor::getDelayCompensationInSamples() const noexcept
+{
+    // マルチバンドではゲインをベースレートで適用するので補償しない
+    if (activeNumBands > 1)
+        return 0;
+
+    // アップサンプル側のフィルターは全体の遅延のおよそ半分
+    return juce::roundToInt(getOversampling().getLatencyInSamples() / 2.0);
+}
+
+int HeuristicLimiterAudioProcessor::getTotalLatencyInSamples() const noexcept
+{
+    const auto useLowLatency = lowLatencyActive.load();
+    const auto& o = getOversampling();
+    const auto lookAheadSamples = static_cast<int>(getSampleRate() * (useLowLatency ? LOOKAHEAD_TIME_LOW_LATENCY : LOOKAHEAD_TIME) / 1000.0);
+
+    // 補償した分はオーバーサンプラーの遅延に含まれている
+    return juce::roundToInt(o.getLatencyInSamples()) + lookAheadSamples - juce::jmin(getDelayCompensationInSamples(), lookAheadSamples);
+}
+
+void HeuristicLimiterAudioProcessor::timerCallback()
+{
+    if (latencyChanged.exchange(false))
+        setLatencySamples(getTotalLatencyInSamples());
+}
+
+HeuristicLimiterAudioProcessor::ProcessingMode HeuristicLimiterAudioProcessor::getRequestedProcessingMode() const noexcept
+{
+    switch (mode->getIndex()) {
+        case 1:  return ProcessingMode::eco;
+        case 2:  return ProcessingMode::realtime;
+        case 3:  return ProcessingMode::highQuality;
+        default: return isNonRealtime() ? ProcessingMode::highQuality : ProcessingMode::realtime;
+    }
+}
+
+void HeuristicLimiterAudioProcessor::setProcessingMode(ProcessingMode newMode) noexcept
+{
+    const auto oversamplingChanged = MODE_SETTINGS[static_cast<size_t>(newMode)].reducedOversampling != getModeSettings().reducedOversampling;
+    processingModeActive = newMode;
+
+    for (auto& band : bands)
+        band->simulator.setAnalysisBinStride(getModeSettings().analysisBinStride);
+
+    // 探索の方式が変わるので履歴を消す
+    bands[0]->simulator.reset();
+    trajectoryOptimizer.reset();
+
+    // オーバーサンプラーの遅延が変わる場合は補償とレイテンシーを更新する
+    if (oversamplingChanged) {
+        for (auto& band : bands)
+            band->compressor.setDelayCompensation(getDelayCompensationInSamples());
+
+        getOversampling().reset();
+        latencyChanged = true;
+    }
+}
+
+double HeuristicLimiterAudioProcessor::getMaximumAttackTime() const noexcept
+{
+    // 低レイテンシーモードではアタックをルックアヘッド以内に収める
+    const auto maximumAttackTime = getModeSettings().maximumAttackTime;
+    return lowLatencyActive ? juce::jmin(LOOKAHEAD_TIME_LOW_LATENCY, maximumAttackTime) : maximumAttackTime;
+}
+
+void HeuristicLimiterAudioProcessor::setNumBands(int newNumBands) noexcept
+{
+    // バンドの帯域が変わると学習した予測は当てはまらない
+    const auto bandsChanged = juce::jlimit(1, MAX_BANDS, newNumBands) != activeNumBands;
+    activeNumBands = juce::jlimit(1, MAX_BANDS, newNumBands);
+    crossover.setBands(activeNumBands, CROSSOVER_FREQUENCIES[static_cast<size_t>(activeNumBands - 1)]);
+
+    // ソフトクリップはバンドの合計にかかるので、探索で通すのはシングルバンドのみ
+    const auto isSingleBand = activeNumBands == 1;
+
+    for (auto& band : bands) {
+        band->compressor.reset();
+        band->compressor.setDelayCompensation(getDelayCompensationInSamples());
+        band->simulator.reset();
+        band->simulator.setShaperEnabled(isSingleBand);
+        band->predictor.reset();
+        if (bandsChanged)
+            band->predictor.clearTable();
+    }
+    trajectoryOptimizer.reset();
+
+    getOversampling().reset();
+
+    // 遅延補償が変わるのでレイテンシーを通知し直す
+    latencyChanged = true;
+}
+
+void HeuristicLimiterAudioProcessor::applyWarmStart() noexcept
+{
+    for (auto& band : bands) {
+        band->compressor.setAttack(band->attack);
+        band->compressor.setRelease(band->release);
+        band->warmStartBlocks = WARM_START_BLOCKS;
+    }
+}
+
+float HeuristicLimiterAudioProcessor::getEffectiveRatio() const noexcept
+{
+    // リミッターはレシオ∞、レシオのノブは表示どおりの値（20は20:1）
+    return *limiter ? std::numeric_limits<float>::infinity() : float{*ratio};
+}
 
-        return result;
+void HeuristicLimiterAudioProcessor::searchAttackAndRelease(Band& band, const juce::dsp::AudioBlock<float>& block,
+                                                            const juce::dsp::AudioBlock<const float>& keyBlock) noexcept
+{
+    // ヌルテストでは探索せず固定の値を使う
+    if (applyPinnedSearchResult(band))
+        return;
+
+    auto& compressor = band.compressor;
+    auto& simulator = band.simulator;
+
+    // 参照スペクトルを更新（スライディングDFT、ブロック境界に依存しない）
+    simulator.beginBlock(compressor, block, keyBlock);
+
+    const auto& settings = getModeSettings();
+
+    // ブロックの特徴量から予測（学習済みのセルのみ、検出に使う信号で測る）
+    const auto& features = band.predictor.analyse(keyBlock, *threshold, getEffectiveRatio());
+    double centreAttack = 0.0, centreRelease = 0.0;
+    // 予測が自分の結果に引きずられないよう、一定間隔でフル探索に戻す
+    const auto fullSearchDue = band.blocksSinceFullSearch >= PREDICTOR_REFRESH_BLOCKS;
+    auto narrowed = *predictorMode && ! fullSearchDue && band.predictor.predict(features, centreAttack, centreRelease);
+
+    // 復元・prepareの直後は前回の動作点から始める
+    if (! narrowed && band.warmStartBlocks > 0) {
+        --band.warmStartBlocks;
+        centreAttack = band.attack;
+        centreRelease = band.release;
+        narrowed = true;
+    }
+
+    juce::uint32 numEvaluations = 0;
+    const auto search = [&numEvaluations, &settings, narrowed](auto objective, double centre, double maximum) {
+        const auto countedObjective = [&numEvaluations, &objective](double time) {
+            ++numEvaluations;
+            return objective(time);
+        };
+
+        // minimize differences（シミュレーションと本番は同じレートなので、求めた値をそのまま使う）
+        if (! narrowed)
+            return boost::math::tools::brent_find_minima(countedObjective, 0.0, maximum, settings.searchBits).first;
+
+        // 中心値の周り（1/2〜2倍）を反復回数の上限付きで探索する
+        boost::uintmax_t iterations = NARROW_SEARCH_ITERATIONS;
+        return boost::math::tools::brent_find_minima(
+            countedObjective,
+            juce::jmin(centre * 0.5, maximum * 0.5),
+            juce::jmin(centre * 2.0 + 1.0, maximum),
+            juce::jmin(NARROW_SEARCH_BITS, settings.searchBits),
+            iterations
+        ).first;
     };
+
+    const auto release = search(simulator.getObjective<Simulator::Parameter::release>(), centreRelease, settings.maximumReleaseTime);
+    compressor.setRelease(static_cast<float>(release));
+
+    const auto attack = search(simulator.getObjective<Simulator::Parameter::attack>(), centreAttack, getMaximumAttackTime());
+    compressor.setAttack(static_cast<float>(attack));
+
+    band.attack = static_cast<float>(attack);
+    band.release = static_cast<float>(release);
+    band.numSearches.fetch_add(1, std::memory_order_relaxed);
+    band.numEvaluations.fetch_add(numEvaluations, std::memory_order_relaxed);
+
+    // フル探索の結果からのみ学習する（絞った探索の結果は予測値に寄るので使わない）
+    if (narrowed) {
+        ++band.blocksSinceFullSearch;
+    } else {
+        band.blocksSinceFullSearch = 0;
+        band.predictor.learn(features, attack, release);
+    }
+
+    // 決定した値での出力を次のブロックのシミュレーション用に残す
+    simulator.endBlock();
+}
+
+bool HeuristicLimiterAudioProcessor::applyPinnedSearchResult(Band& band) noexcept
+{
+    const auto* results = pinnedSearchResults.load();
+    if (results == nullptr || results->empty())
+        return false;
+
+    // 今のモードの範囲に収める（低レイテンシーではアタックがルックアヘッド以内）
+    const auto& result = (*results)[juce::jmin(pinnedSearchPosition, results->size() - 1)];
+    const auto attack = juce::jmin(result.attack, static_cast<float>(getMaximumAttackTime()));
+    const auto release = juce::jmin(result.release, static_cast<float>(getModeSettings().maximumReleaseTime));
+
+    band.compressor.setAttack(attack);
+    band.compressor.setRelease(release);
+    band.attack = attack;
+    band.release = release;
+    return true;
+}
+
+void HeuristicLimiterAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
+{
+    processInChunks(buffer, false);
+}
+
+void HeuristicLimiterAudioProcessor::processBlockBypassed(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
+{
+    processInChunks(buffer, true);
 }
 
-void HeuristicLimiterAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+void HeuristicLimiterAudioProcessor::processInChunks(juce::AudioBuffer<float>& buffer, bool isBypassed)
 {
+    // モード・バンド数などの切り替えも含めてコールバック全体を確保禁止にする
+    dsp_original::AllocationGuard::ScopedAudioCallback allocationGuard;
+    const auto callbackStart = dsp_original::CallbackStatistics::Clock::now();
+    const auto numSamples = buffer.getNumSamples();
+    jassert(maximumBlockSize > 0);
+
+    // prepareToPlayより長いブロックが来た場合は最大ブロック長ごとに分割する（作業領域・オーバーサンプラーの上限）
+    for (int start = 0; start < numSamples; start += maximumBlockSize) {
+        juce::AudioBuffer<float> chunk(buffer.getArrayOfWritePointers(), buffer.getNumChannels(),
+                                       start, juce::jmin(maximumBlockSize, numSamples - start));
+        if (isBypassed)
+            processChunkBypassed(chunk);
+        else
+            processChunk(chunk);
+    }
+
+    // コールバック全体の処理時間と出力の異常（NaN・0dBFS超え）を記録（バイパス中の0dBFS超えは入力のもの）
+    callbackStatistics.callbackFinished(callbackStart, getSampleRate(),
+                                        juce::dsp::AudioBlock<float>(buffer).getSubsetChannelBlock(0, static_cast<size_t>(getTotalNumOutputChannels())),
+                                        ! isBypassed);
+}
+
+void HeuristicLimiterAudioProcessor::processChunk(juce::AudioBuffer<float>& buffer)
+{
+    // このブロックの処理期限（並列タスクのjoinに使う）
+    callbackDeadline = dsp_original::RealtimeTaskScheduler::Clock::now()
+        + std::chrono::duration_cast<dsp_original::RealtimeTaskScheduler::Clock::duration>(
+            std::chrono::duration<double>(buffer.getNumSamples() / getSampleRate()));
+
+    // 低レイテンシーモード・バンド数の切り替え
+    if (*lowLatency != lowLatencyActive)
+        setLowLatencyMode(*lowLatency);
+    if (*numBands != activeNumBands)
+        setNumBands(*numBands);
+
+    if (warmStartPending.exchange(false))
+        applyWarmStart();
+
+    // 処理モードの切り替え（Autoではオフラインレンダリングかどうかで決まる）
+    if (const auto requestedMode = getRequestedProcessingMode(); requestedMode != processingModeActive)
+        setProcessingMode(requestedMode);
+
     // applying parameters
-    processorChain.get<compressorIndex>().setThreshold(*threshold);
-    processorChain.get<compressorIndex>().setRatio(*ratio);
+    for (int i = 0; i < activeNumBands; ++i) {
+        auto& compressor = bands[static_cast<size_t>(i)]->compressor;
+        compressor.setThreshold(*threshold);
+        compressor.setRatio(getEffectiveRatio());
+        compressor.setKnee(*knee);
+        // 全チャンネルで検出とゲインを共有する
+        compressor.setStereoLink(*stereoLink);
+
+        // ゲイン計算をコントロールレートに間引く（基準レンダリングでは毎サンプル・std::powのカーブ）
+        compressor.setControlRateInterval(*controlRate && ! referenceRendering ? CONTROL_RATE_INTERVAL : 1);
+        compressor.setUseExactGainCurve(referenceRendering);
+    }
 
     juce::ScopedNoDenormals noDenormals;
-    auto totalNumInputChannels  = getTotalNumInputChannels();
+    auto totalNumInputChannels  = getMainBusNumInputChannels(); // サイドチェーンを除く
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
     // In case we have more outputs than inputs, this code clears any output
@@ -235,22 +626,13 @@ void HeuristicLimiterAudioProcessor::processBlock (juce::AudioBuffer<float>& buf
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    // Gain audio before simulation
-    buffer.applyGain(juce::Decibels::decibelsToGain(float{*gain}));    // 暫定
-    
-    // FFT処理
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
-    {
-		const auto numSamplesLookAhead = processorChain.get<compressorIndex>().getLatencyInSamples();
-
-		// TODO
-        std::copy_n(buffer.getReadPointer(channel), buffer.getNumSamples(), fftBuffer[channel].begin());
-		std::rotate(fftBuffer[channel].begin(), fftBuffer[channel].end() - numSamplesLookAhead % fftBuffer[channel].size(), fftBuffer[channel].end());
-        std::fill(fftBuffer[channel].begin() + buffer.getNumSamples(), fftBuffer[channel].end(), 0.0f);
-        std::fill(fftBuffer[channel].begin(), fftBuffer[channel].begin() + numSamplesLookAhead % fftBuffer[channel].size(), 0.0f);
-
-        fft.performFrequencyOnlyForwardTransform(fftBuffer[channel].data());
-    }
+    // メインのチャンネルのピーク（メーター用）
+    const auto getMainPeak = [&buffer, totalNumOutputChannels] {
+        auto peak = 0.0f;
+        for (int channel = 0; channel < totalNumOutputChannels; ++channel)
+            peak = juce::jmax(peak, buffer.getMagnitude(channel, 0, buffer.getNumSamples()));
+        return peak;
+    };
 
     // This is the place where you'd normally do the guts of your plugin's
     // audio processing...
@@ -258,65 +640,206 @@ void HeuristicLimiterAudioProcessor::processBlock (juce::AudioBuffer<float>& buf
     // the samples and the outer loop is handling the channels.
     // Alternatively, you can process the samples with the channels
     // interleaved by keeping the same state.
-    juce::dsp::AudioBlock<float> block(buffer);
-
-    // コピー用のバッファを生成
-    juce::dsp::AudioBlock<float> resultBlock(temporaryResultBuffer2);
-    juce::dsp::ProcessContextNonReplacing<float> simulate(block, resultBlock);
-
-    // minimize differences
-    const auto release = boost::math::tools::brent_find_minima(
-        getFuncCalculateDiff<true>(simulate, totalNumInputChannels, fftBuffer),
-        0.0,
-        300.0,
-        24
-    ).first;
-    processorChain.get<compressorIndex>().setRelease(static_cast<float>(release / OVERSAMPLE_RATIO));
-
-    const auto attack = boost::math::tools::brent_find_minima(
-        getFuncCalculateDiff<false>(simulate, totalNumInputChannels, fftBuffer),
-        0.0,
-        30.0,
-        24
-    ).first;
-    processorChain.get<compressorIndex>().setAttack(static_cast<float>(attack));
-    processorChain.get<compressorIndex>().setRelease(static_cast<float>(release));
+    // バッファの後ろにあるサイドチェーンのチャンネルは含めない
+    auto block = juce::dsp::AudioBlock<float>(buffer).getSubsetChannelBlock(0, static_cast<size_t>(totalNumOutputChannels));
+    auto& currentOversampling = getOversampling();
+    juce::dsp::AudioBlock<float> blockOver;
 
-    // get oversampled buffer
-    auto blockOver = oversampling.processSamplesUp(block);
+    // Gain audio before simulation
+    block.multiplyBy(juce::Decibels::decibelsToGain(float{*gain}));    // 暫定
+    const auto inputPeak = getMainPeak();
+
+    // サイドチェーン（ベースレートのまま、必要ならハイパスをかけて検出と参照スペクトルに使う）
+    auto sidechainBlock = getSidechainBlock(buffer);
+    const auto sidechainFilterOn = sidechainBlock.getNumChannels() > 0 && *sidechainHighPass > sidechainHighPass->range.start;
+    if (sidechainFilterOn) {
+        // 前にオンだった時の状態が残っているとクリックになる
+        if (! sidechainFilterActive)
+            sidechainFilter.reset();
+        sidechainFilter.setCutoffFrequency(*sidechainHighPass);
+        sidechainFilter.process(juce::dsp::ProcessContextReplacing<float>(sidechainBlock));
+    }
+    sidechainFilterActive = sidechainFilterOn;
+    const auto hasSidechain = sidechainBlock.getNumChannels() > 0;
+
+    if (activeNumBands == 1)
+    {
+        auto& compressor = bands[0]->compressor;
+        const auto inputBlock = block.getSubsetChannelBlock(0, static_cast<size_t>(totalNumInputChannels));
+        const auto keyBlock = juce::dsp::AudioBlock<const float>(hasSidechain ? sidechainBlock : inputBlock);
+
+        if (getModeSettings().optimiseTrajectory && pinnedSearchResults.load() == nullptr)
+        {
+            // 高品質：ブロック内の窓毎のアタック・リリースをまとめて最適化する
+            trajectoryOptimizer.setRanges(getMaximumAttackTime(), getModeSettings().maximumReleaseTime);
+            trajectoryOptimizer.optimise(compressor, inputBlock, keyBlock, callbackDeadline);
+
+            // 検出とルックアヘッド遅延（窓毎に値を切り替え、ゲインは続けて溜める）
+            const auto windowSize = trajectoryOptimizer.getWindowSize();
+            for (size_t w = 0; w < trajectoryOptimizer.getNumWindows(); ++w) {
+                const auto start = w * windowSize;
+                const auto length = juce::jmin(windowSize, block.getNumSamples() - start);
+                auto window = block.getSubBlock(start, length);
+                const auto keyWindow = keyBlock.getSubBlock(start, length);
+
+                compressor.setAttack(trajectoryOptimizer.getAttack(w));
+                compressor.setRelease(trajectoryOptimizer.getRelease(w));
+                compressor.processDetection(juce::dsp::ProcessContextReplacing<float>(window), keyWindow, start);
+            }
+
+            // 最後の窓の値を動作点として残す
+            if (const auto numWindows = trajectoryOptimizer.getNumWindows(); numWindows > 0) {
+                bands[0]->attack = trajectoryOptimizer.getAttack(numWindows - 1);
+                bands[0]->release = trajectoryOptimizer.getRelease(numWindows - 1);
+            }
+        }
+        else
+        {
+            searchAttackAndRelease(*bands[0], inputBlock, keyBlock);
 
-    // エラー対策
-	blockOver = blockOver.getSubsetChannelBlock(0, totalNumOutputChannels);
+            // 検出とルックアヘッド遅延（ベースレート）
+            compressor.processDetection(juce::dsp::ProcessContextReplacing<float>(block), keyBlock);
+        }
 
-    juce::dsp::ProcessContextReplacing<float> context(blockOver);
+        // get oversampled buffer
+        blockOver = currentOversampling.processSamplesUp(block);
 
-    // process
-    processorChain.process(context);
+        // エラー対策
+        blockOver = blockOver.getSubsetChannelBlock(0, totalNumOutputChannels);
+
+        // process（ゲインを補間して適用）
+        compressor.applyGain(juce::dsp::ProcessContextReplacing<float>(blockOver));
+    }
+    else
+    {
+        // 帯域分割
+        std::array<juce::dsp::AudioBlock<float>, MAX_BANDS> bandBlocks;
+        for (int i = 0; i < activeNumBands; ++i)
+            bandBlocks[static_cast<size_t>(i)] = juce::dsp::AudioBlock<float>(bands[static_cast<size_t>(i)]->buffer.data(),
+                                                                               static_cast<size_t>(totalNumInputChannels),
+                                                                               static_cast<size_t>(buffer.getNumSamples()));
+
+        crossover.process(block.getSubsetChannelBlock(0, static_cast<size_t>(totalNumInputChannels)), bandBlocks);
+
+        // バンド毎の探索と処理をワーカーで並列に行う（ゲインはベースレートで適用）
+        dsp_original::RealtimeTaskScheduler::TaskGroup group;
+        for (int i = 0; i < activeNumBands; ++i) {
+            taskScheduler.submit(group, [this, &bandBlocks, &sidechainBlock, hasSidechain, i] {
+                juce::ScopedNoDenormals workerNoDenormals;
+                auto& band = *bands[static_cast<size_t>(i)];
+                auto& bandBlock = bandBlocks[static_cast<size_t>(i)];
+
+                // サイドチェーンは帯域分割せず全バンドの検出に使う
+                const auto keyBlock = juce::dsp::AudioBlock<const float>(hasSidechain ? sidechainBlock : bandBlock);
+
+                searchAttackAndRelease(band, bandBlock, keyBlock);
+                band.compressor.process(juce::dsp::ProcessContextReplacing<float>(bandBlock), keyBlock);
+            });
+        }
+        taskScheduler.join(group, callbackDeadline);
+
+        // 合算
+        auto inputBlock = block.getSubsetChannelBlock(0, static_cast<size_t>(totalNumInputChannels));
+        inputBlock.copyFrom(bandBlocks[0]);
+        for (int i = 1; i < activeNumBands; ++i)
+            inputBlock.add(bandBlocks[static_cast<size_t>(i)]);
+
+        // get oversampled buffer
+        blockOver = currentOversampling.processSamplesUp(block);
+
+        // エラー対策
+        blockOver = blockOver.getSubsetChannelBlock(0, totalNumOutputChannels);
+    }
+
+    // 固定した探索結果は次のチャンクの分へ進める
+    if (pinnedSearchResults.load() != nullptr)
+        ++pinnedSearchPosition;
+
+    // ソフトクリップ
+    ceiling.process(juce::dsp::ProcessContextReplacing<float>(blockOver));
+
+    // トゥルーピーク計測（4倍以上ならオーバーサンプル済みの出力をそのまま使う）
+    const auto oversamplingRatio = currentOversampling.getOversamplingFactor();
+    if (oversamplingRatio >= 4)
+        truePeakMeter.measureOversampled(blockOver, oversamplingRatio);
 
     // downsample oversampled buffer
-    oversampling.processSamplesDown(block);
+    currentOversampling.processSamplesDown(block);
+
+    // ダウンサンプラーのリンギングで天井を越えた分は 0 dBFS でクリップする
+    for (size_t channel = 0; channel < block.getNumChannels(); ++channel)
+        juce::FloatVectorOperations::clip(block.getChannelPointer(channel), block.getChannelPointer(channel),
+                                          -1.0f, 1.0f, static_cast<int>(block.getNumSamples()));
+
+    if (oversamplingRatio < 4)
+        truePeakMeter.measure(block);
+
+    // ラウドネス計測（ベースレートの出力）
+    loudnessMeter.process(block);
+
+    updateMeters(inputPeak, getMainPeak(), buffer.getNumSamples());
 }
 
-void HeuristicLimiterAudioProcessor::processBlockBypassed(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
+juce::dsp::AudioBlock<float> HeuristicLimiterAudioProcessor::getSidechainBlock(juce::AudioBuffer<float>& buffer) noexcept
 {
-    // 一回経由させる
-    // get oversampled buffer
-    juce::dsp::AudioBlock<float> block(buffer);
-    auto blockOver = oversampling.processSamplesUp(block);
-    juce::dsp::ProcessContextReplacing<float> context(blockOver);
+    // メインの入力の後ろのチャンネル（バスが無効なら空）
+    const auto numMainChannels = getMainBusNumInputChannels();
+    const auto numSidechainChannels = juce::jmin(getTotalNumInputChannels() - numMainChannels, MAX_CHANNELS);
+
+    if (numSidechainChannels <= 0)
+        return {};
+
+    return juce::dsp::AudioBlock<float>(buffer).getSubsetChannelBlock(static_cast<size_t>(numMainChannels),
+                                                                      static_cast<size_t>(numSidechainChannels));
+}
+
+void HeuristicLimiterAudioProcessor::updateMeters(float inputPeak, float outputPeak, int numSamples) noexcept
+{
+    // 間隔内のピークは最大値、ゲインリダクションは最大の減衰を残す
+    auto minimumGain = 1.0f;
+    for (int i = 0; i < activeNumBands; ++i)
+        minimumGain = juce::jmin(minimumGain, bands[static_cast<size_t>(i)]->compressor.getMinimumGainOfLastBlock());
+
+    meterAccumulator.inputPeak = juce::jmax(meterAccumulator.inputPeak, inputPeak);
+    meterAccumulator.outputPeak = juce::jmax(meterAccumulator.outputPeak, outputPeak);
+    meterAccumulator.gainReduction = juce::jmax(meterAccumulator.gainReduction, -juce::Decibels::gainToDecibels(minimumGain));
+    meterNumSamples += numSamples;
+
+    if (meterNumSamples < meterIntervalSamples)
+        return;
+
+    meterAccumulator.attack = bands[0]->attack;
+    meterAccumulator.release = bands[0]->release;
+    meterAccumulator.loudness = loudnessMeter.getReport();
+
+    // エディタが読んでいなければ捨てる（待たない）
+    meterQueue.push(meterAccumulator);
+    meterAccumulator = {};
+    meterNumSamples = 0;
+}
+
+void HeuristicLimiterAudioProcessor::processChunkBypassed(juce::AudioBuffer<float>& buffer)
+{
+    // 一回経由させる（ルックアヘッド遅延のみ、サイドチェーンのチャンネルは含めない）
+    auto block = juce::dsp::AudioBlock<float>(buffer).getSubsetChannelBlock(0, static_cast<size_t>(getTotalNumOutputChannels()));
+    juce::dsp::ProcessContextReplacing<float> context(block);
     context.isBypassed = true;
 
     // process
-    processorChain.process(context);
+    bands[0]->compressor.process(context);
+
+    // get oversampled buffer
+    auto& currentOversampling = getOversampling();
+    currentOversampling.processSamplesUp(block);
 
     // downsample oversampled buffer
-    oversampling.processSamplesDown(block);
+    currentOversampling.processSamplesDown(block);
 }
 
 //==============================================================================
 bool HeuristicLimiterAudioProcessor::hasEditor() const
 {
-    return false; // (change this to false if you choose to not supply an editor)
+    return true; // (change this to false if you choose to not supply an editor)
 }
 
 juce::AudioProcessorEditor* HeuristicLimiterAudioProcessor::createEditor()
@@ -335,6 +858,28 @@ void HeuristicLimiterAudioProcessor::getStateInformation (juce::MemoryBlock& des
     xml->setAttribute("gain", *gain);
     xml->setAttribute("threshold", *threshold);
     xml->setAttribute("ratio", *ratio);
+    xml->setAttribute("knee", *knee);
+    xml->setAttribute("lowLatency", *lowLatency ? 1 : 0);
+    xml->setAttribute("controlRate", *controlRate ? 1 : 0);
+    xml->setAttribute("bands", numBands->get());
+    xml->setAttribute("predictor", *predictorMode ? 1 : 0);
+    xml->setAttribute("mode", mode->getIndex());
+    xml->setAttribute("link", *stereoLink ? 1 : 0);
+    xml->setAttribute("sidechainHighPass", *sidechainHighPass);
+    xml->setAttribute("limiter", *limiter ? 1 : 0);
+
+    // 探索の動作点と統計（バージョン付きバイナリをbase64で）
+    dsp_original::OptimizerState optimizerState;
+    optimizerState.numBands = MAX_BANDS;
+    for (int i = 0; i < MAX_BANDS; ++i) {
+        const auto& band = *bands[static_cast<size_t>(i)];
+        auto& record = optimizerState.bands[static_cast<size_t>(i)];
+        record.attack = band.attack;
+        record.release = band.release;
+        record.numSearches = band.numSearches;
+        record.numEvaluations = band.numEvaluations;
+    }
+    xml->setAttribute("optimizer", optimizerState.toBase64());
 
     copyXmlToBinary(*xml, destData);
 }
@@ -349,10 +894,54 @@ void HeuristicLimiterAudioProcessor::setStateInformation (const void* data, int
         *gain = xmlState->getDoubleAttribute("gain", 0.0);
         *threshold = xmlState->getDoubleAttribute("threshold", -0.3);
         *ratio = xmlState->getDoubleAttribute("ratio", 4.0);
+        *knee = xmlState->getDoubleAttribute("knee", 0.0);
+        *lowLatency = xmlState->getIntAttribute("lowLatency", 0) != 0;
+        *controlRate = xmlState->getIntAttribute("controlRate", 0) != 0;
+        *numBands = xmlState->getIntAttribute("bands", 1);
+        *predictorMode = xmlState->getIntAttribute("predictor", 0) != 0;
+        *mode = xmlState->getIntAttribute("mode", 0);
+        *stereoLink = xmlState->getIntAttribute("link", 0) != 0;
+        *sidechainHighPass = xmlState->getDoubleAttribute("sidechainHighPass", 20.0);
+        *limiter = xmlState->getIntAttribute("limiter", 0) != 0;
+
+        // 古い状態（属性なし）や壊れたデータでは何もしない
+        dsp_original::OptimizerState optimizerState;
+        if (optimizerState.fromBase64(xmlState->getStringAttribute("optimizer"), MAX_BANDS)) {
+            for (int i = 0; i < optimizerState.numBands; ++i) {
+                auto& band = *bands[static_cast<size_t>(i)];
+                const auto& record = optimizerState.bands[static_cast<size_t>(i)];
+                // 探索範囲の外（負の値・極端な値）は範囲内に収めてから使う
+                band.attack = juce::jlimit(0.0f, static_cast<float>(MAXIMUM_ATTACK_TIME), record.attack);
+                band.release = juce::jlimit(0.0f, static_cast<float>(MAXIMUM_RELEASE_TIME), record.release);
+                band.numSearches = record.numSearches;
+                band.numEvaluations = record.numEvaluations;
+            }
+            warmStartPending = true;
+        }
     }
 
 }
 
+//==============================================================================
+size_t HeuristicLimiterAudioProcessor::getMemoryUsageInBytes() const noexcept
+{
+    // オーバーサンプラー内部のバッファは各段のサイズから概算する
+    size_t oversamplingBytes = 0;
+    for (auto factor : {OVERSAMPLE_FACTOR, OVERSAMPLE_FACTOR_ECO})
+        for (int stage = 1; stage <= factor; ++stage)
+            oversamplingBytes += static_cast<size_t>(getTotalNumOutputChannels() * maximumBlockSize << stage) * sizeof(float);
+
+    size_t bandBytes = 0;
+    for (auto& band : bands)
+        bandBytes += sizeof(Band) + band->compressor.getMemoryUsageInBytes() + band->simulator.getMemoryUsageInBytes();
+
+    return sizeof(*this)
+         + scratchArena.getCapacity()
+         + bandBytes
+         + trajectoryOptimizer.getMemoryUsageInBytes()
+         + oversamplingBytes;
+}
+
 //==============================================================================
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
@@ -10,11 +10,24 @@
 
 #include <JuceHeader.h>
 #include "LookForwardingCompressor.h"
+#include "HeuristicSimulator.h"
+#include "TrajectoryOptimizer.h"
+#include "ParameterPredictor.h"
+#include "OptimizerState.h"
+#include "MultibandCrossover.h"
+#include "RealtimeTaskScheduler.h"
+#include "ScratchArena.h"
+#include "AllocationGuard.h"
+#include "TruePeakMeter.h"
+#include "LoudnessMeter.h"
+#include "CallbackStatistics.h"
+#include "MeterFifo.h"
 
 //==============================================================================
 /**
 */
-class HeuristicLimiterAudioProcessor  : public juce::AudioProcessor
+class HeuristicLimiterAudioProcessor  : public juce::AudioProcessor,
+                                        private juce::Timer
 {
 public:
     //==============================================================================
@@ -55,42 +68,228 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
+    //==============================================================================
+    /** Returns the approximate memory used by this instance after prepareToPlay(). */
+    size_t getMemoryUsageInBytes() const noexcept;
+
+    /** Output true-peak statistics (overshoots above 0 dBTP), safe to read from any thread. */
+    dsp_original::TruePeakMeter& getTruePeakMeter() noexcept { return truePeakMeter; }
+
+    /** Output loudness (momentary, short-term, integrated), safe to read from any thread. */
+    dsp_original::LoudnessMeter& getLoudnessMeter() noexcept { return loudnessMeter; }
+
+    /** Worst-case callback time, deadline misses and output NaNs/overs, safe to read from any thread. */
+    dsp_original::CallbackStatistics& getCallbackStatistics() noexcept { return callbackStatistics; }
+
+    /** Renders with the detector on every sample and the gain curve evaluated with std::pow,
+        whatever the parameters ask for. Used as the reference of the null tests; set it
+        before prepareToPlay().
+    */
+    void setReferenceRendering(bool shouldRenderReference) noexcept { referenceRendering = shouldRenderReference; }
+
+    /** Attack and release in milliseconds, as chosen for one processed chunk. */
+    struct SearchResult
+    {
+        float attack = 1.0f, release = 100.0f;
+    };
+
+    /** Skips the attack/release search and takes the values of every processed chunk from
+        the given sequence instead, one entry per chunk, keeping the last one when it runs
+        out. All bands get the same values, limited to the ranges of the active mode. Null
+        tests use it to give a reference and its variants the same search results. Set it
+        before prepareToPlay(); nullptr searches again.
+    */
+    void setPinnedSearchResults(const std::vector<SearchResult>* results) noexcept { pinnedSearchResults = results; }
+
+    /** The attack and release band 0 processed the last chunk with. */
+    SearchResult getLastSearchResult() const noexcept { return { bands[0]->attack.load(), bands[0]->release.load() }; }
+
+    /** Levels and search results of about 10 ms of audio, sent from the audio thread to the editor. */
+    struct MeterFrame
+    {
+        float inputPeak = 0.0f, outputPeak = 0.0f; // linear, after the input gain / at the output
+        float gainReduction = 0.0f;                // dB, largest reduction over all bands
+        float attack = 0.0f, release = 0.0f;       // ms, band 0
+        dsp_original::LoudnessMeter::Report loudness; // LUFS at the output, latest values
+    };
+    using MeterQueue = dsp_original::MeterFifo<MeterFrame, 256>;
+
+    /** Meter frames for the editor; only one reader may pop them. */
+    MeterQueue& getMeterQueue() noexcept { return meterQueue; }
+
 private:
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HeuristicLimiterAudioProcessor)
+
+    // エディタはパラメータに直接アタッチする
+    friend class HeuristicLimiterAudioProcessorEditor;
   
     // parameters
     juce::AudioParameterFloat *const gain,
                               *const threshold,
-                              *const ratio;
-  
-    enum {
-      compressorIndex,
-      waveShaperIndex
-    };
+                              *const ratio,
+                              *const knee,
+                              *const sidechainHighPass;
+    juce::AudioParameterBool *const lowLatency,
+                             *const controlRate,
+                             *const predictorMode,
+                             *const stereoLink,
+                             *const limiter;
+    juce::AudioParameterInt *const numBands;
+    juce::AudioParameterChoice *const mode;
 
     constexpr static int OVERSAMPLE_FACTOR = 4, OVERSAMPLE_RATIO = 1 << OVERSAMPLE_FACTOR;
-    constexpr static double LOOKAHEAD_TIME = 5.0;
+    constexpr static int OVERSAMPLE_FACTOR_ECO = 2;
+    constexpr static int MAX_CHANNELS = 2;
+    constexpr static double LOOKAHEAD_TIME = 5.0, LOOKAHEAD_TIME_LOW_LATENCY = 0.5;
+    constexpr static int CONTROL_RATE_INTERVAL = 8; // ベースレートのサンプル数
+    constexpr static double MAXIMUM_ATTACK_TIME = 30.0, MAXIMUM_RELEASE_TIME = 300.0;
+    constexpr static int NARROW_SEARCH_BITS = 12, NARROW_SEARCH_ITERATIONS = 4; // 予測値・前回値からの探索の予算
+    constexpr static int WARM_START_BLOCKS = 16; // 復元・prepare後に前回値の周りだけを探索するブロック数
+    constexpr static int PREDICTOR_REFRESH_BLOCKS = 32; // 予測モードでもこのブロック数毎にフル探索して学習する
+    constexpr static double METER_INTERVAL_TIME = 10.0; // エディタに送るメーター値の間隔（ms）
+    constexpr static int LATENCY_CHECK_RATE = 20;       // レイテンシー変更を確認する頻度（Hz）
+
+    // 処理モード（探索の予算と範囲、オーバーサンプリング倍率、解析の分解能をまとめたもの）
+    enum class ProcessingMode
+    {
+        eco,
+        realtime,
+        highQuality
+    };
+    struct ModeSettings
+    {
+        int searchBits;
+        double maximumAttackTime, maximumReleaseTime;
+        bool reducedOversampling; // OVERSAMPLE_FACTOR_ECOのオーバーサンプラーを使う
+        int analysisBinStride;    // スペクトル距離に使う解析ビンの間隔
+        bool optimiseTrajectory;  // 窓毎の軌跡最適化（シングルバンドのみ）
+    };
+    constexpr static std::array<ModeSettings, 3> MODE_SETTINGS {{
+        { 12, 20.0, 200.0, true, 2, false },                                  // eco
+        { 24, MAXIMUM_ATTACK_TIME, MAXIMUM_RELEASE_TIME, false, 1, false },   // realtime
+        { 24, MAXIMUM_ATTACK_TIME, MAXIMUM_RELEASE_TIME, false, 1, true }     // high quality
+    }};
+    constexpr static int MAX_BANDS = dsp_original::MultibandCrossover<float>::maxBands;
+    static_assert(MAX_BANDS <= dsp_original::OptimizerState::maxBands);
+
+    // バンド数毎のクロスオーバー周波数（Hz）
+    constexpr static std::array<dsp_original::MultibandCrossover<float>::Frequencies, MAX_BANDS> CROSSOVER_FREQUENCIES {{
+        { 0.0f, 0.0f, 0.0f, 0.0f },
+        { 200.0f, 0.0f, 0.0f, 0.0f },
+        { 150.0f, 2500.0f, 0.0f, 0.0f },
+        { 120.0f, 800.0f, 5000.0f, 0.0f },
+        { 100.0f, 400.0f, 1600.0f, 6000.0f }
+    }};
   
-    // filters
-    juce::dsp::ProcessorChain<
-        dsp_original::LookAheadCompressor<float>,
-        juce::dsp::WaveShaper<float>
-    > processorChain;
-    juce::dsp::Oversampling<float> oversampling;
-
-    // FFT用
-    juce::dsp::FFT fft;
-    std::vector<std::vector<float>> fftBuffer;
-    
-    // 一時コピー用バッファ
-    juce::AudioBuffer<float> temporaryResultBuffer, temporaryResultBuffer2;
-
-    // 誤差計測用の関数を返す
-    template<bool is_release>
-    auto getFuncCalculateDiff(
-        const juce::dsp::ProcessContextNonReplacing<float>& simulate,
-        int totalNumInputChannels,
-        const decltype(fftBuffer)& buffer
-    );
+    // ソフトクリップ（関数ポインタを経由せずインライン展開させる）
+    struct SoftClip
+    {
+        float operator()(float x) const noexcept { return std::tanh(x); }
+    };
+
+    // サイドチェーン（ベースレートで検出と参照スペクトルに使う。ハイパスは最小値でオフ）
+    juce::dsp::LinkwitzRileyFilter<float> sidechainFilter;
+    bool sidechainFilterActive = false; // オフ（20Hz）からオンになったら状態を捨てる
+    juce::dsp::AudioBlock<float> getSidechainBlock(juce::AudioBuffer<float>& buffer) noexcept;
+
+    // 最終段のソフトクリップ（オーバーサンプル後、バンドの合算後にかける）
+    juce::dsp::WaveShaper<float, SoftClip> ceiling;
+
+    // 通常は直線位相FIR、低レイテンシーモードではIIRのオーバーサンプラーを使う
+    // エコモードでは倍率を下げたものを使う（どちらもprepareで準備しておく）
+    juce::dsp::Oversampling<float> oversampling, oversamplingLowLatency, oversamplingEco, oversamplingEcoLowLatency;
+    std::atomic<bool> lowLatencyActive { false };
+
+    // 出力のトゥルーピーク・ラウドネス計測
+    dsp_original::TruePeakMeter truePeakMeter;
+    dsp_original::LoudnessMeter loudnessMeter;
+
+    // コールバックの処理時間・出力の異常の統計
+    dsp_original::CallbackStatistics callbackStatistics;
+
+    // 基準レンダリング（ヌルテスト用、毎サンプルの検出・std::powのゲインカーブ）
+    std::atomic<bool> referenceRendering { false };
+
+    // 探索結果の固定（ヌルテスト用、チャンク毎に1つ進む）
+    std::atomic<const std::vector<SearchResult>*> pinnedSearchResults { nullptr };
+    size_t pinnedSearchPosition = 0;
+
+    // エディタ用のメーター（一定間隔毎にまとめてキューに送る）
+    MeterQueue meterQueue;
+    MeterFrame meterAccumulator;
+    int meterNumSamples = 0, meterIntervalSamples = 1;
+    void updateMeters(float inputPeak, float outputPeak, int numSamples) noexcept;
+
+    // ブロック毎の作業領域（prepareToPlayで一括確保）
+    dsp_original::ScratchArena scratchArena;
+    int maximumBlockSize = 0;
+
+    // バンドとグリッド候補の並列処理用
+    dsp_original::RealtimeTaskScheduler taskScheduler;
+    dsp_original::RealtimeTaskScheduler::Clock::time_point callbackDeadline;
+
+    // アタック・リリース探索用のシミュレーション（ベースレート）
+    using Simulator = dsp_original::HeuristicSimulator<SoftClip>;
+
+    // バンド毎のコンプレッサーと探索（シングルバンドではバンド0のみ）
+    struct Band
+    {
+        dsp_original::LookAheadCompressor<float> compressor;
+        Simulator simulator;
+        dsp_original::ParameterPredictor predictor;
+        std::array<float*, MAX_CHANNELS> buffer {};
+
+        // 探索の動作点と統計（状態の保存用に他のスレッドから読む）
+        std::atomic<float> attack { 1.0f }, release { 100.0f };
+        std::atomic<juce::uint32> numSearches { 0 }, numEvaluations { 0 };
+        int warmStartBlocks = 0, blocksSinceFullSearch = 0;
+    };
+    std::array<std::unique_ptr<Band>, MAX_BANDS> bands;
+    dsp_original::MultibandCrossover<float> crossover;
+    std::atomic<int> activeNumBands { 1 };
+
+    // 保存・復元した動作点からの再開要求（オーディオスレッドで反映する）
+    std::atomic<bool> warmStartPending { false };
+    void applyWarmStart() noexcept;
+
+    // オフラインレンダリング時の窓毎の最適化（シングルバンドのみ）
+    using Trajectory = dsp_original::TrajectoryOptimizer<SoftClip>;
+    Trajectory trajectoryOptimizer { taskScheduler };
+
+    // 処理モードの切り替え（Autoではオフラインレンダリング時に高品質）
+    std::atomic<ProcessingMode> processingModeActive { ProcessingMode::realtime };
+    ProcessingMode getRequestedProcessingMode() const noexcept;
+    void setProcessingMode(ProcessingMode newMode) noexcept;
+    const ModeSettings& getModeSettings() const noexcept { return MODE_SETTINGS[static_cast<size_t>(processingModeActive.load())]; }
+    double getMaximumAttackTime() const noexcept;
+
+    // 低レイテンシーモードの切り替え
+    void setLowLatencyMode(bool shouldUseLowLatency) noexcept;
+    juce::dsp::Oversampling<float>& getOversampling() noexcept;
+    const juce::dsp::Oversampling<float>& getOversampling() const noexcept;
+    int getDelayCompensationInSamples() const noexcept;
+    int getTotalLatencyInSamples() const noexcept;
+
+    // ホストへのレイテンシー通知（オーディオスレッドはフラグを立てるだけで、メッセージスレッドのタイマーが拾う）
+    std::atomic<bool> latencyChanged { false };
+    void timerCallback() override;
+
+    // バンド数の切り替え
+    void setNumBands(int newNumBands) noexcept;
+
+    // LIMITERがオンならレシオ∞
+    float getEffectiveRatio() const noexcept;
+
+    // アタック・リリースを探索してコンプレッサーに設定する
+    void searchAttackAndRelease(Band& band, const juce::dsp::AudioBlock<float>& block,
+                                const juce::dsp::AudioBlock<const float>& keyBlock) noexcept;
+
+    // 固定した探索結果があればコンプレッサーに設定してtrueを返す
+    bool applyPinnedSearchResult(Band& band) noexcept;
+
+    // 最大ブロック長ごとの処理
+    void processInChunks(juce::AudioBuffer<float>& buffer, bool isBypassed);
+    void processChunk(juce::AudioBuffer<float>& buffer);
+    void processChunkBypassed(juce::AudioBuffer<float>& buffer);
 };
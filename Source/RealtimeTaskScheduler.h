@@ -0,0 +1,481 @@
+/*
+  ==============================================================================
+
+    RealtimeTaskScheduler.h
+    Lock-free work-stealing task scheduler usable from the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#endif
+
+namespace dsp_original
+{
+
+        /**
+            A small work-stealing scheduler for fork/join work inside processBlock().
+
+            Every task lives in a preallocated slot, so submit() never locks or
+            allocates. Tasks are pushed round-robin onto per-worker queues and idle
+            workers steal from each other.
+
+            The worker threads belong to one pool that is shared by every scheduler
+            in the process, so a session with many plugin instances still has only
+            a few workers. An idle worker blocks on a semaphore. submit() posts that
+            semaphore only when a worker is asleep, which is an atomic counter and a
+            lock-free platform call, so nothing polls while no audio is running.
+
+            Only one thread (the audio thread) may call submit() and join() on a
+            scheduler. While joining, that thread also runs queued tasks itself.
+            Once the deadline has passed, it stops waiting for the workers and
+            drains the remaining queue inline.
+        */
+        class RealtimeTaskScheduler
+        {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+            static constexpr int maxTasks = 64;
+            static constexpr size_t taskStorageSize = 64;
+
+            /** A set of tasks that is joined together. */
+            class TaskGroup
+            {
+            public:
+                TaskGroup() = default;
+
+                bool isFinished() const noexcept { return pending.load(std::memory_order_acquire) == 0; }
+
+            private:
+                friend class RealtimeTaskScheduler;
+                std::atomic<int> pending { 0 };
+
+                JUCE_DECLARE_NON_COPYABLE(TaskGroup)
+            };
+
+            //==============================================================================
+            /** Attaches to the shared worker pool, starting it if this is the first scheduler. */
+            RealtimeTaskScheduler()
+                : queues(static_cast<size_t>(std::max(pool->getNumWorkers(), 1)))
+            {
+                poolIndex = pool->add(this);
+            }
+
+            ~RealtimeTaskScheduler()
+            {
+                pool->remove(poolIndex);
+            }
+
+            static int getDefaultNumWorkers() noexcept
+            {
+                const auto numCpus = static_cast<int>(std::thread::hardware_concurrency());
+                return std::clamp(numCpus - 1, 0, 3);
+            }
+
+            /** Returns the number of workers of the shared pool, 0 if tasks run inline. */
+            int getNumWorkers() const noexcept { return poolIndex >= 0 ? pool->getNumWorkers() : 0; }
+
+            //==============================================================================
+            /** Queues a task. The callable is copied into a preallocated slot, so it must
+                be small and trivially copyable (e.g. a lambda capturing references).
+                Falls back to running the task inline if no slot or queue space is free.
+            */
+            template <typename Callable>
+            void submit(TaskGroup& group, const Callable& callable) noexcept
+            {
+                static_assert(sizeof(Callable) <= taskStorageSize, "task is too large for its slot");
+                static_assert(alignof(Callable) <= alignof(std::max_align_t), "task is over-aligned");
+                static_assert(std::is_trivially_copyable_v<Callable>, "task must be trivially copyable");
+
+                if (getNumWorkers() == 0)
+                {
+                    callable();
+                    return;
+                }
+
+                const auto slotIndex = nextSlot;
+                auto& task = tasks[static_cast<size_t>(slotIndex)];
+
+                if (task.busy.load(std::memory_order_acquire))
+                {
+                    jassertfalse; // too many outstanding tasks, join more often
+                    callable();
+                    return;
+                }
+
+                nextSlot = (nextSlot + 1) % maxTasks;
+
+                new (task.storage) Callable(callable);
+                task.invoke = [](void* storage) { (*static_cast<Callable*>(storage))(); };
+                task.group = &group;
+                task.busy.store(true, std::memory_order_relaxed);
+                group.pending.fetch_add(1, std::memory_order_relaxed);
+
+                if (! queues[static_cast<size_t>(nextQueue)].push(slotIndex))
+                {
+                    task.busy.store(false, std::memory_order_relaxed);
+                    group.pending.fetch_sub(1, std::memory_order_relaxed);
+                    callable();
+                    return;
+                }
+
+                nextQueue = (nextQueue + 1) % static_cast<int>(queues.size());
+                pool->wakeOne();
+            }
+
+            /** Helps with the queued work until every task of the group has finished.
+
+                Returns false if the group was not finished by the deadline; in that case
+                the remaining queued tasks have been run on the calling thread.
+
+                The deadline is soft: a task that a worker has already started is always
+                waited for, because it refers to the caller's stack. A late task
+                therefore still makes join() return late.
+            */
+            bool join(TaskGroup& group, Clock::time_point deadline) noexcept
+            {
+                bool deadlineMet = true;
+
+                while (! group.isFinished())
+                {
+                    if (runOneTask(0))
+                        continue;
+
+                    if (deadlineMet && Clock::now() > deadline)
+                        deadlineMet = false;
+
+                    // only tasks already running on workers are left
+                    std::this_thread::yield();
+                }
+
+                return deadlineMet && Clock::now() <= deadline;
+            }
+
+        private:
+            //==============================================================================
+            struct Task
+            {
+                alignas(std::max_align_t) unsigned char storage[taskStorageSize];
+                void (*invoke)(void*) = nullptr;
+                TaskGroup* group = nullptr;
+                std::atomic<bool> busy { false };
+            };
+
+            /** Bounded single-producer/multi-consumer ring of task slot indices. */
+            struct WorkQueue
+            {
+                static constexpr uint32_t capacity = maxTasks;
+
+                bool push(int taskIndex) noexcept
+                {
+                    const auto t = tail.load(std::memory_order_relaxed);
+
+                    if (t - head.load(std::memory_order_acquire) >= capacity)
+                        return false;
+
+                    items[t % capacity].store(taskIndex, std::memory_order_relaxed);
+                    tail.store(t + 1, std::memory_order_release);
+                    return true;
+                }
+
+                int pop() noexcept
+                {
+                    auto h = head.load(std::memory_order_acquire);
+
+                    for (;;)
+                    {
+                        if (h == tail.load(std::memory_order_acquire))
+                            return -1;
+
+                        const auto taskIndex = items[h % capacity].load(std::memory_order_relaxed);
+
+                        if (head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                            return taskIndex;
+                    }
+                }
+
+                std::array<std::atomic<int>, capacity> items {};
+                alignas(64) std::atomic<uint32_t> head { 0 };
+                alignas(64) std::atomic<uint32_t> tail { 0 };
+            };
+
+            //==============================================================================
+            bool runOneTask(int firstQueue) noexcept
+            {
+                const auto numQueues = static_cast<int>(queues.size());
+
+                for (int i = 0; i < numQueues; ++i)
+                {
+                    const auto taskIndex = queues[static_cast<size_t>((firstQueue + i) % numQueues)].pop();
+
+                    if (taskIndex >= 0)
+                    {
+                        auto& task = tasks[static_cast<size_t>(taskIndex)];
+                        auto* group = task.group;
+
+                        task.invoke(task.storage);
+                        task.busy.store(false, std::memory_order_release);
+                        group->pending.fetch_sub(1, std::memory_order_acq_rel);
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            bool hasQueuedTasks() const noexcept
+            {
+                for (const auto& queue : queues)
+                    if (queue.head.load(std::memory_order_acquire) != queue.tail.load(std::memory_order_acquire))
+                        return true;
+
+                return false;
+            }
+
+            //==============================================================================
+            /** A counting semaphore that can be posted from the audio thread: a dispatch
+                semaphore on Apple platforms, a futex/WaitOnAddress wait elsewhere.
+            */
+            class Semaphore
+            {
+            public:
+               #if JUCE_MAC || JUCE_IOS
+                Semaphore() : semaphore(dispatch_semaphore_create(0)) {}
+                ~Semaphore() { dispatch_release(semaphore); }
+
+                void post() noexcept { dispatch_semaphore_signal(semaphore); }
+                void wait() noexcept { dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER); }
+
+            private:
+                dispatch_semaphore_t semaphore;
+               #else
+                Semaphore() = default;
+
+                void post() noexcept
+                {
+                    count.fetch_add(1, std::memory_order_release);
+                    count.notify_one();
+                }
+
+                void wait() noexcept
+                {
+                    for (;;)
+                    {
+                        auto value = count.load(std::memory_order_acquire);
+
+                        if (value > 0)
+                        {
+                            if (count.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel))
+                                return;
+                        }
+                        else
+                        {
+                            count.wait(value, std::memory_order_acquire);
+                        }
+                    }
+                }
+
+            private:
+                std::atomic<int> count { 0 };
+               #endif
+
+                JUCE_DECLARE_NON_COPYABLE(Semaphore)
+            };
+
+            /** The worker threads shared by every scheduler in the process.
+
+                Schedulers register in a fixed table. A worker marks a table entry as
+                visited before reading it, and remove() waits until no worker visits the
+                entry any more, so a scheduler can be destroyed while the workers run.
+            */
+            class WorkerPool
+            {
+            public:
+                static constexpr int maxSchedulers = 256;
+
+                WorkerPool()
+                {
+                    const auto numWorkers = getDefaultNumWorkers();
+                    workers.reserve(static_cast<size_t>(numWorkers));
+
+                    for (int i = 0; i < numWorkers; ++i)
+                        workers.emplace_back([this, i] { runWorker(i); });
+                }
+
+                ~WorkerPool()
+                {
+                    shouldExit.store(true);
+
+                    for (size_t i = 0; i < workers.size(); ++i)
+                    {
+                        numPendingWakes.fetch_add(1);
+                        wakeUp.post();
+                    }
+
+                    for (auto& worker : workers)
+                        worker.join();
+                }
+
+                int getNumWorkers() const noexcept { return static_cast<int>(workers.size()); }
+
+                /** Registers a scheduler; returns its entry, or -1 if the table is full. */
+                int add(RealtimeTaskScheduler* scheduler) noexcept
+                {
+                    for (int i = 0; i < maxSchedulers; ++i)
+                    {
+                        RealtimeTaskScheduler* expected = nullptr;
+
+                        if (schedulers[static_cast<size_t>(i)].compare_exchange_strong(expected, scheduler))
+                        {
+                            for (auto end = numEntries.load(); end < i + 1 && ! numEntries.compare_exchange_weak(end, i + 1);) {}
+                            return i;
+                        }
+                    }
+
+                    jassertfalse; // too many instances, the rest run their tasks inline
+                    return -1;
+                }
+
+                /** Unregisters a scheduler and waits until no worker is inside it. */
+                void remove(int index) noexcept
+                {
+                    if (index < 0)
+                        return;
+
+                    schedulers[static_cast<size_t>(index)].store(nullptr);
+
+                    while (numVisitors[static_cast<size_t>(index)].load() > 0)
+                        std::this_thread::yield();
+                }
+
+                /** Wakes a sleeping worker, if there is one that is not being woken already.
+                    Never blocks, and never posts more than there are sleepers.
+                */
+                void wakeOne() noexcept
+                {
+                    // orders the caller's tail store before the numSleeping load; pairs
+                    // with the fence in runWorker() (a release store alone may pass it)
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                    auto pending = numPendingWakes.load();
+
+                    while (pending < numSleeping.load())
+                    {
+                        if (numPendingWakes.compare_exchange_weak(pending, pending + 1))
+                        {
+                            wakeUp.post();
+                            return;
+                        }
+                    }
+                }
+
+            private:
+                /** Runs at most one task of each scheduler, starting at a different one per worker. */
+                bool runQueuedTasks(int workerIndex) noexcept
+                {
+                    const auto end = numEntries.load(std::memory_order_acquire);
+                    auto ranTask = false;
+
+                    for (int i = 0; i < end; ++i)
+                    {
+                        const auto index = static_cast<size_t>((workerIndex + i) % end);
+                        numVisitors[index].fetch_add(1);
+
+                        if (auto* scheduler = schedulers[index].load())
+                            ranTask = scheduler->runOneTask(workerIndex) || ranTask;
+
+                        numVisitors[index].fetch_sub(1);
+                    }
+
+                    return ranTask;
+                }
+
+                bool hasQueuedTasks() noexcept
+                {
+                    const auto end = numEntries.load(std::memory_order_acquire);
+                    auto result = false;
+
+                    for (size_t index = 0; index < static_cast<size_t>(end) && ! result; ++index)
+                    {
+                        numVisitors[index].fetch_add(1);
+
+                        if (auto* scheduler = schedulers[index].load())
+                            result = scheduler->hasQueuedTasks();
+
+                        numVisitors[index].fetch_sub(1);
+                    }
+
+                    return result;
+                }
+
+                void runWorker(int workerIndex) noexcept
+                {
+                    int idleCount = 0;
+
+                    while (! shouldExit.load(std::memory_order_acquire))
+                    {
+                        if (runQueuedTasks(workerIndex))
+                        {
+                            idleCount = 0;
+                            continue;
+                        }
+
+                        // spin briefly while the tasks of a block are arriving
+                        if (++idleCount < 64)
+                        {
+                            std::this_thread::yield();
+                            continue;
+                        }
+
+                        // then sleep; announcing it before the last check means a task that
+                        // is pushed after that check always sees a sleeper and posts
+                        numSleeping.fetch_add(1);
+                        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                        if (! hasQueuedTasks() && ! shouldExit.load())
+                        {
+                            wakeUp.wait();
+                            numPendingWakes.fetch_sub(1);
+                        }
+
+                        numSleeping.fetch_sub(1);
+                        idleCount = 0;
+                    }
+                }
+
+                std::array<std::atomic<RealtimeTaskScheduler*>, maxSchedulers> schedulers {};
+                std::array<std::atomic<int>, maxSchedulers> numVisitors {};
+                std::atomic<int> numEntries { 0 }, numSleeping { 0 }, numPendingWakes { 0 };
+                std::atomic<bool> shouldExit { false };
+                Semaphore wakeUp;
+                std::vector<std::thread> workers;
+
+                JUCE_DECLARE_NON_COPYABLE(WorkerPool)
+            };
+
+            //==============================================================================
+            std::array<Task, maxTasks> tasks;
+            juce::SharedResourcePointer<WorkerPool> pool;
+            std::vector<WorkQueue> queues;
+            int poolIndex = -1;
+            int nextSlot = 0, nextQueue = 0;
+
+            JUCE_DECLARE_NON_COPYABLE(RealtimeTaskScheduler)
+        };
+
+} // namespace dsp_original
@@ -0,0 +1,99 @@
+/*
+  ==============================================================================
+
+    ScratchArena.h
+    Aligned bump allocator for per-block working memory.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace dsp_original
+{
+
+        /**
+            One aligned block of memory that per-block scratch buffers are carved from.
+
+            The arena is sized once in prepareToPlay() and never grows, so handing out
+            buffers on the audio thread is just a pointer bump. Use getRequiredBytes()
+            to add up the sizes before calling prepare().
+        */
+        class ScratchArena
+        {
+        public:
+            static constexpr size_t alignment = 64;
+
+            ScratchArena() = default;
+
+            /** Returns the number of bytes an allocation of numElements will occupy. */
+            template <typename ElementType>
+            static constexpr size_t getRequiredBytes(size_t numElements) noexcept
+            {
+                return alignUp(numElements * sizeof(ElementType));
+            }
+
+            /** (Re)allocates the arena. Call this from prepareToPlay() only. */
+            void prepare(size_t numBytes)
+            {
+                numBytes = alignUp(numBytes);
+
+                if (numBytes != capacity)
+                {
+                    storage.reset(numBytes > 0 ? new std::byte[numBytes + alignment] : nullptr);
+                    capacity = numBytes;
+                }
+
+                reset();
+            }
+
+            /** Forgets every allocation made so far. */
+            void reset() noexcept
+            {
+                auto address = reinterpret_cast<std::uintptr_t>(storage.get());
+                base = reinterpret_cast<std::byte*>(alignUp(static_cast<size_t>(address)));
+                used = 0;
+            }
+
+            /** Hands out an aligned, zeroed buffer of numElements. */
+            template <typename ElementType>
+            ElementType* allocate(size_t numElements) noexcept
+            {
+                const auto numBytes = getRequiredBytes<ElementType>(numElements);
+
+                if (used + numBytes > capacity)
+                {
+                    jassertfalse; // the arena was sized too small in prepareToPlay()
+                    return nullptr;
+                }
+
+                auto* result = base + used;
+                used += numBytes;
+
+                std::fill_n(result, numBytes, std::byte {});
+                return reinterpret_cast<ElementType*>(result);
+            }
+
+            size_t getCapacity() const noexcept { return capacity; }
+            size_t getNumBytesUsed() const noexcept { return used; }
+
+        private:
+            static constexpr size_t alignUp(size_t numBytes) noexcept
+            {
+                return (numBytes + alignment - 1) & ~(alignment - 1);
+            }
+
+            std::unique_ptr<std::byte[]> storage;
+            std::byte* base = nullptr;
+            size_t capacity = 0, used = 0;
+
+            JUCE_DECLARE_NON_COPYABLE(ScratchArena)
+        };
+
+} // namespace dsp_original
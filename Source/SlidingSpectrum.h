@@ -0,0 +1,218 @@
+/*
+  ==============================================================================
+
+    SlidingSpectrum.h
+    Hann-windowed sliding DFT on a fixed set of analysis bins.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace dsp_original
+{
+
+        /**
+            Tracks the spectrum of the last frameSize samples of a stream at a few
+            log-spaced bins, with the sliding DFT X_k(n) = e^(j2pi k/N) (X_k(n-1) + x(n) - x(n-N)).
+
+            The Hann window is applied from the neighbouring bins,
+            -X_(k-1)/4 + X_k/2 - X_(k+1)/4, which are tracked as well.
+            computeFrameMagnitudes() gives the same measure for a buffered frame.
+        */
+        class SlidingSpectrum
+        {
+        public:
+            static constexpr int maxChannels = 2;
+            static constexpr int maxBins = 64;
+
+            SlidingSpectrum() = default;
+
+            /** Returns the power-of-two frame size closest above the given duration. */
+            static int getFrameSizeFor(double sampleRate, double frameTimeInMilliseconds) noexcept
+            {
+                return juce::nextPowerOfTwo(juce::jmax(16, juce::roundToInt(sampleRate * frameTimeInMilliseconds / 1000.0)));
+            }
+
+            //==============================================================================
+            /** Chooses the analysis bins and allocates the state. Bins closer together than
+                one DFT bin are merged, so getNumBins() may end up below numBinsToUse.
+            */
+            void prepare(double sampleRate, int frameSizeToUse, int numBinsToUse, int numChannelsToUse)
+            {
+                jassert(juce::isPowerOfTwo(frameSizeToUse));
+                jassert(numBinsToUse > 0 && numBinsToUse <= maxBins);
+
+                frameSize = frameSizeToUse;
+                numChannels = juce::jlimit(1, maxChannels, numChannelsToUse);
+                fft = std::make_unique<juce::dsp::FFT>(static_cast<int>(std::log2(frameSize)));
+
+                // log-spaced between 40 Hz and 16 kHz (or just below Nyquist)
+                const auto lowest = 40.0, highest = juce::jmin(16000.0, 0.45 * sampleRate);
+                const auto maximumIndex = frameSize / 2 - 1;
+                numBins = 0;
+
+                for (int i = 0; i < numBinsToUse; ++i)
+                {
+                    const auto frequency = lowest * std::pow(highest / lowest, i / static_cast<double>(juce::jmax(1, numBinsToUse - 1)));
+                    const auto index = juce::jlimit(1, maximumIndex, juce::roundToInt(frequency * frameSize / sampleRate));
+
+                    if (numBins == 0 || index > binIndices[static_cast<size_t>(numBins - 1)])
+                        binIndices[static_cast<size_t>(numBins++)] = index;
+                }
+
+                // every selected bin needs its two neighbours for the window
+                trackedIndices.clear();
+                for (int i = 0; i < numBins; ++i)
+                    for (auto index : { binIndices[static_cast<size_t>(i)] - 1, binIndices[static_cast<size_t>(i)], binIndices[static_cast<size_t>(i)] + 1 })
+                        if (trackedIndices.empty() || index > trackedIndices.back())
+                            trackedIndices.push_back(index);
+
+                for (int i = 0; i < numBins; ++i)
+                {
+                    const auto centre = std::find(trackedIndices.begin(), trackedIndices.end(), binIndices[static_cast<size_t>(i)]);
+                    trackedCentre[static_cast<size_t>(i)] = static_cast<int>(centre - trackedIndices.begin());
+                }
+
+                // slightly damped rotation, so rounding errors cannot accumulate
+                twiddleReal.resize(trackedIndices.size());
+                twiddleImag.resize(trackedIndices.size());
+                for (size_t i = 0; i < trackedIndices.size(); ++i)
+                {
+                    const auto angle = juce::MathConstants<double>::twoPi * trackedIndices[i] / frameSize;
+                    twiddleReal[i] = damping * std::cos(angle);
+                    twiddleImag[i] = damping * std::sin(angle);
+                }
+
+                dampingOfOldest = std::pow(damping, frameSize);
+
+                window.resize(static_cast<size_t>(frameSize));
+                for (int i = 0; i < frameSize; ++i)
+                    window[static_cast<size_t>(i)] = static_cast<float>(0.5 - 0.5 * std::cos(juce::MathConstants<double>::twoPi * i / frameSize));
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    binsReal[static_cast<size_t>(channel)].resize(trackedIndices.size());
+                    binsImag[static_cast<size_t>(channel)].resize(trackedIndices.size());
+                    history[static_cast<size_t>(channel)].resize(static_cast<size_t>(frameSize));
+                }
+
+                reset();
+            }
+
+            /** Clears the tracked spectra and the sample history. */
+            void reset() noexcept
+            {
+                for (int channel = 0; channel < maxChannels; ++channel)
+                {
+                    std::fill(binsReal[static_cast<size_t>(channel)].begin(), binsReal[static_cast<size_t>(channel)].end(), 0.0);
+                    std::fill(binsImag[static_cast<size_t>(channel)].begin(), binsImag[static_cast<size_t>(channel)].end(), 0.0);
+                    std::fill(history[static_cast<size_t>(channel)].begin(), history[static_cast<size_t>(channel)].end(), 0.0);
+                }
+
+                historyPosition.fill(0);
+            }
+
+            //==============================================================================
+            /** Adds one sample of a channel, O(bins). */
+            void pushSample(int channel, double inputValue) noexcept
+            {
+                auto& channelHistory = history[static_cast<size_t>(channel)];
+                auto& position = historyPosition[static_cast<size_t>(channel)];
+
+                const auto difference = inputValue - dampingOfOldest * channelHistory[static_cast<size_t>(position)];
+                channelHistory[static_cast<size_t>(position)] = inputValue;
+                position = (position + 1) & (frameSize - 1);
+
+                // separate real and imaginary arrays, so the loop vectorises
+                auto* re = binsReal[static_cast<size_t>(channel)].data();
+                auto* im = binsImag[static_cast<size_t>(channel)].data();
+                const auto* wr = twiddleReal.data();
+                const auto* wi = twiddleImag.data();
+
+                for (size_t i = 0; i < twiddleReal.size(); ++i)
+                {
+                    const auto a = re[i] + difference, b = im[i];
+                    re[i] = wr[i] * a - wi[i] * b;
+                    im[i] = wr[i] * b + wi[i] * a;
+                }
+            }
+
+            /** Writes the windowed magnitude of each analysis bin of the last frameSize samples. */
+            void getMagnitudes(int channel, float* destination) const noexcept
+            {
+                const auto* re = binsReal[static_cast<size_t>(channel)].data();
+                const auto* im = binsImag[static_cast<size_t>(channel)].data();
+
+                for (int i = 0; i < numBins; ++i)
+                {
+                    const auto centre = static_cast<size_t>(trackedCentre[static_cast<size_t>(i)]);
+                    destination[i] = static_cast<float>(std::hypot(0.5 * re[centre] - 0.25 * (re[centre - 1] + re[centre + 1]),
+                                                                   0.5 * im[centre] - 0.25 * (im[centre - 1] + im[centre + 1])));
+                }
+            }
+
+            /** Measures a frame of frameSize samples at the same bins and with the same window.
+                The workspace must hold 2 * frameSize floats and may be the frame itself.
+            */
+            void computeFrameMagnitudes(const float* frame, float* workspace, float* destination) const noexcept
+            {
+                computeFrameMagnitudes(*fft, frame, workspace, destination);
+            }
+
+            /** Like computeFrameMagnitudes(), with an FFT of frameSize owned by the caller.
+                JUCE's fallback FFT locks while it transforms, so concurrent callers each
+                need their own.
+            */
+            void computeFrameMagnitudes(const juce::dsp::FFT& fftToUse, const float* frame, float* workspace, float* destination) const noexcept
+            {
+                jassert(fftToUse.getSize() == frameSize);
+
+                for (int i = 0; i < frameSize; ++i)
+                    workspace[i] = frame[i] * window[static_cast<size_t>(i)];
+
+                std::fill(workspace + frameSize, workspace + 2 * frameSize, 0.0f);
+                fftToUse.performFrequencyOnlyForwardTransform(workspace);
+
+                for (int i = 0; i < numBins; ++i)
+                    destination[i] = workspace[binIndices[static_cast<size_t>(i)]];
+            }
+
+            //==============================================================================
+            int getFrameSize() const noexcept { return frameSize; }
+            int getNumBins() const noexcept { return numBins; }
+
+            size_t getMemoryUsageInBytes() const noexcept
+            {
+                return static_cast<size_t>(numChannels) * (2 * trackedIndices.size() + static_cast<size_t>(frameSize)) * sizeof(double)
+                     + 2 * twiddleReal.size() * sizeof(double) + window.size() * sizeof(float);
+            }
+
+        private:
+            //==============================================================================
+            static constexpr double damping = 0.999999;
+
+            int frameSize = 0, numBins = 0, numChannels = maxChannels;
+            std::unique_ptr<juce::dsp::FFT> fft;
+            std::vector<float> window;
+
+            std::array<int, maxBins> binIndices {}, trackedCentre {};
+            std::vector<int> trackedIndices;
+            std::vector<double> twiddleReal, twiddleImag;
+            double dampingOfOldest = 1.0;
+
+            std::array<std::vector<double>, maxChannels> binsReal, binsImag;
+            std::array<std::vector<double>, maxChannels> history;
+            std::array<int, maxChannels> historyPosition {};
+
+            JUCE_DECLARE_NON_COPYABLE(SlidingSpectrum)
+        };
+
+} // namespace dsp_original
@@ -0,0 +1,479 @@
+/*
+  ==============================================================================
+
+    TrajectoryOptimizer.h
+    Block-wise global attack/release trajectory for non-realtime rendering.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "LookForwardingCompressor.h"
+#include "RealtimeTaskScheduler.h"
+#include "ScratchArena.h"
+#include "SlidingSpectrum.h"
+
+namespace dsp_original
+{
+
+        /**
+            Chooses attack and release for every analysis window of a block at once,
+            instead of one pair per block found by a greedy search.
+
+            The optimisation runs in two passes over the block.
+
+            In the analysis pass, every candidate of an attack x release grid runs over
+            the whole block from the state of the production compressor. The output is
+            scored against the reference spectrum at the end of each window, with the
+            same measure as HeuristicSimulator. This gives a cost curve over the grid
+            for every window. The candidates are spread over the scheduler's workers,
+            and each worker has its own compressor, FFT and scratch ("slot").
+
+            A Viterbi pass then picks the path through the windows with the lowest sum
+            of costs plus a penalty per grid step between neighbouring windows. The
+            path starts from the last choice of the previous block, so the trajectory
+            stays smooth across blocks.
+
+            In the render pass, the caller applies getAttack() / getRelease() window
+            by window to the production compressor.
+
+            A window's cost assumes the candidate has been in use since the block
+            started. This is exact for the first window and an approximation after
+            that. It is what makes the candidates independent, so they can run in
+            parallel.
+
+            It uses far more evaluations per block than the realtime search, so it is
+            meant for offline rendering only.
+        */
+        template <typename ShaperFunction>
+        class TrajectoryOptimizer
+        {
+        public:
+            using Compressor = LookAheadCompressor<float>;
+            static constexpr int maxChannels = 2;
+            static constexpr int maxSlots = 4;
+            static constexpr int numAttackCandidates = 6, numReleaseCandidates = 10;
+            static constexpr int numCandidates = numAttackCandidates * numReleaseCandidates;
+            static constexpr double analysisFrameTime = 10.0;
+            static constexpr int numAnalysisBins = 32;
+            static constexpr int windowsPerFrame = 4;
+            static constexpr double smoothnessPenalty = 0.25; // cost per grid step between windows
+
+            explicit TrajectoryOptimizer(RealtimeTaskScheduler& schedulerToUse)
+                : scheduler(schedulerToUse)
+            {
+                setRanges(30.0, 300.0);
+            }
+
+            //==============================================================================
+            /** Passed on to the compressors of the slots, see LookAheadCompressor. */
+            void setMaximumLookAheadTime(float newMaximumLookAheadTime)
+            {
+                maximumLookAheadTime = newMaximumLookAheadTime;
+
+                for (auto& slot : slots)
+                    slot.compressor.setMaximumLookAheadTime(newMaximumLookAheadTime);
+            }
+
+            void setLookAheadTime(float newLookAheadTime)
+            {
+                for (auto& slot : slots)
+                    slot.compressor.setLookAheadTime(newLookAheadTime);
+            }
+
+            /** Sets the upper ends of the candidate grid in milliseconds. Each axis is 0 plus
+                log-spaced values from 1/100 of the maximum up to the maximum.
+            */
+            void setRanges(double maximumAttack, double maximumRelease) noexcept
+            {
+                fillCandidates(attackCandidates, maximumAttack);
+                fillCandidates(releaseCandidates, maximumRelease);
+            }
+
+            /** Returns the scratch memory prepare() takes from the arena. */
+            static size_t getRequiredScratchBytes(double sampleRate, int maximumBlockSize) noexcept
+            {
+                const auto workspaceSize = static_cast<size_t>(2 * SlidingSpectrum::getFrameSizeFor(sampleRate, analysisFrameTime));
+
+                return maxSlots * maxChannels * (ScratchArena::getRequiredBytes<float>(workspaceSize)
+                                                 + ScratchArena::getRequiredBytes<float>(static_cast<size_t>(maximumBlockSize)));
+            }
+
+            /** Prepares the slots at the host rate, the same spec as the production compressor. */
+            void prepare(const juce::dsp::ProcessSpec& spec, ScratchArena& arena)
+            {
+                jassert(spec.numChannels <= static_cast<juce::uint32>(maxChannels));
+
+                const auto frameSize = SlidingSpectrum::getFrameSizeFor(spec.sampleRate, analysisFrameTime);
+                referenceSpectrum.prepare(spec.sampleRate, frameSize, numAnalysisBins, static_cast<int>(spec.numChannels));
+
+                windowSize = static_cast<size_t>(frameSize / windowsPerFrame);
+                maximumNumWindows = (spec.maximumBlockSize + windowSize - 1) / windowSize;
+
+                const auto referenceDelaySize = static_cast<size_t>(spec.sampleRate * maximumLookAheadTime / 1000.0) + 1;
+
+                for (size_t channel = 0; channel < maxChannels; ++channel)
+                {
+                    referenceDelay[channel].assign(referenceDelaySize, 0.0f);
+                    outputHistory[channel].assign(static_cast<size_t>(frameSize), 0.0f);
+                }
+
+                for (auto& slot : slots)
+                {
+                    slot.compressor.prepare(spec);
+                    slot.fft = std::make_unique<juce::dsp::FFT>(static_cast<int>(std::log2(frameSize)));
+
+                    for (size_t channel = 0; channel < maxChannels; ++channel)
+                    {
+                        slot.workspace[channel] = arena.allocate<float>(static_cast<size_t>(2 * frameSize));
+                        slot.output[channel] = arena.allocate<float>(spec.maximumBlockSize);
+                    }
+                }
+
+                referenceMagnitudes.assign(maximumNumWindows * maxChannels * SlidingSpectrum::maxBins, 0.0f);
+                costs.assign(maximumNumWindows * numCandidates, 0.0);
+                predecessors.assign(maximumNumWindows * numCandidates, 0);
+                trajectory.assign(maximumNumWindows, 0);
+
+                reset();
+            }
+
+            /** Clears the reference spectrum, the output history and the previous choice. */
+            void reset() noexcept
+            {
+                referenceSpectrum.reset();
+                referenceDelayPosition = 0;
+                previousChoice = -1;
+                numWindows = 0;
+
+                for (size_t channel = 0; channel < maxChannels; ++channel)
+                {
+                    std::fill(referenceDelay[channel].begin(), referenceDelay[channel].end(), 0.0f);
+                    std::fill(outputHistory[channel].begin(), outputHistory[channel].end(), 0.0f);
+                }
+            }
+
+            //==============================================================================
+            /** Finds the trajectory for a block. Call before the production compressor
+                processes the block, then apply the result with getAttack() / getRelease().
+                The candidates detect on the key block, which is also the reference. It is
+                the input itself unless the production compressor follows a sidechain.
+            */
+            void optimise(const Compressor& productionCompressor,
+                          const juce::dsp::AudioBlock<const float>& inputBlock,
+                          const juce::dsp::AudioBlock<const float>& keyBlock,
+                          RealtimeTaskScheduler::Clock::time_point deadline) noexcept
+            {
+                production = &productionCompressor;
+                input = inputBlock;
+                key = keyBlock;
+                numWindows = juce::jmin((input.getNumSamples() + windowSize - 1) / windowSize, maximumNumWindows);
+
+                if (numWindows == 0)
+                    return;
+
+                updateReference();
+
+                // analysis pass: the slots take candidates until none are left
+                nextCandidate.store(0, std::memory_order_relaxed);
+                const auto numSlots = juce::jlimit(1, maxSlots, scheduler.getNumWorkers() + 1);
+                RealtimeTaskScheduler::TaskGroup group;
+
+                for (int slot = 0; slot < numSlots; ++slot)
+                {
+                    scheduler.submit(group, [this, slot] {
+                        juce::ScopedNoDenormals noDenormals;
+                        runSlot(slots[static_cast<size_t>(slot)]);
+                    });
+                }
+
+                scheduler.join(group, deadline);
+
+                findTrajectory();
+                updateHistory();
+            }
+
+            size_t getNumWindows() const noexcept { return numWindows; }
+            size_t getWindowSize() const noexcept { return windowSize; }
+
+            float getAttack(size_t window) const noexcept  { return static_cast<float>(attackCandidates[static_cast<size_t>(trajectory[window] / numReleaseCandidates)]); }
+            float getRelease(size_t window) const noexcept { return static_cast<float>(releaseCandidates[static_cast<size_t>(trajectory[window] % numReleaseCandidates)]); }
+
+            size_t getMemoryUsageInBytes() const noexcept
+            {
+                auto result = referenceSpectrum.getMemoryUsageInBytes()
+                            + maxChannels * (referenceDelay.front().size() + outputHistory.front().size()) * sizeof(float)
+                            + referenceMagnitudes.size() * sizeof(float)
+                            + costs.size() * sizeof(double)
+                            + (predecessors.size() + trajectory.size()) * sizeof(int);
+
+                for (const auto& slot : slots)
+                    result += slot.compressor.getMemoryUsageInBytes();
+
+                return result;
+            }
+
+        private:
+            //==============================================================================
+            struct Slot
+            {
+                Compressor compressor;
+                std::unique_ptr<juce::dsp::FFT> fft;
+                std::array<float*, maxChannels> workspace {}, output {};
+            };
+
+            template <size_t size>
+            static void fillCandidates(std::array<double, size>& candidates, double maximum) noexcept
+            {
+                candidates[0] = 0.0;
+
+                for (size_t i = 1; i < size; ++i)
+                    candidates[i] = maximum * std::pow(0.01, static_cast<double>(size - 1 - i) / static_cast<double>(size - 2));
+            }
+
+            size_t getNumChannels() const noexcept
+            {
+                return juce::jmin(input.getNumChannels(), static_cast<size_t>(maxChannels));
+            }
+
+            size_t getWindowEnd(size_t window) const noexcept
+            {
+                return juce::jmin((window + 1) * windowSize, input.getNumSamples());
+            }
+
+            float* getReferenceMagnitudes(size_t window, size_t channel) noexcept
+            {
+                return referenceMagnitudes.data() + (window * maxChannels + channel) * SlidingSpectrum::maxBins;
+            }
+
+            float shape(float x) const noexcept
+            {
+                return shaper(x);
+            }
+
+            float getKeySample(size_t channel, size_t i) const noexcept
+            {
+                const auto numKeyChannels = key.getNumChannels();
+
+                if (channel + 1 < getNumChannels() || numKeyChannels <= channel + 1)
+                    return key.getChannelPointer(juce::jmin(channel, numKeyChannels - 1))[i];
+
+                auto sum = 0.0f;
+                for (auto keyChannel = channel; keyChannel < numKeyChannels; ++keyChannel)
+                    sum += key.getChannelPointer(keyChannel)[i];
+
+                return sum / static_cast<float>(numKeyChannels - channel);
+            }
+
+            /** Feeds the key, delayed by the look-ahead, to the reference spectrum and keeps
+                its magnitudes at the end of each window, as HeuristicSimulator does.
+            */
+            void updateReference() noexcept
+            {
+                const auto referenceDelaySize = referenceDelay.front().size();
+                const auto numSamplesLookAhead = juce::jmin(static_cast<size_t>(production->getLatencyInSamples()), referenceDelaySize - 1);
+
+                for (size_t channel = 0; channel < getNumChannels(); ++channel)
+                {
+                    auto* delay = referenceDelay[channel].data();
+                    auto position = referenceDelayPosition;
+
+                    for (size_t window = 0, i = 0; window < numWindows; ++window)
+                    {
+                        for (const auto end = getWindowEnd(window); i < end; ++i)
+                        {
+                            delay[position] = getKeySample(channel, i);
+                            referenceSpectrum.pushSample(static_cast<int>(channel), delay[(position + referenceDelaySize - numSamplesLookAhead) % referenceDelaySize]);
+                            position = (position + 1) % referenceDelaySize;
+                        }
+
+                        referenceSpectrum.getMagnitudes(static_cast<int>(channel), getReferenceMagnitudes(window, channel));
+                    }
+                }
+
+                referenceDelayPosition = (referenceDelayPosition + input.getNumSamples()) % referenceDelaySize;
+            }
+
+            void runSlot(Slot& slot) noexcept
+            {
+                for (auto candidate = nextCandidate.fetch_add(1, std::memory_order_relaxed); candidate < numCandidates;
+                     candidate = nextCandidate.fetch_add(1, std::memory_order_relaxed))
+                {
+                    slot.compressor.copyStateFrom(*production);
+                    slot.compressor.setAttack(static_cast<float>(attackCandidates[static_cast<size_t>(candidate / numReleaseCandidates)]));
+                    slot.compressor.setRelease(static_cast<float>(releaseCandidates[static_cast<size_t>(candidate % numReleaseCandidates)]));
+
+                    juce::dsp::AudioBlock<float> outputBlock(slot.output.data(), getNumChannels(), input.getNumSamples());
+                    slot.compressor.process(juce::dsp::ProcessContextNonReplacing<float>(input, outputBlock), key);
+
+                    for (size_t window = 0; window < numWindows; ++window)
+                    {
+                        auto cost = 0.0;
+
+                        for (size_t channel = 0; channel < getNumChannels(); ++channel)
+                            cost += computeSpectralDistance(slot, window, channel);
+
+                        costs[window * numCandidates + static_cast<size_t>(candidate)] = cost;
+                    }
+                }
+            }
+
+            double computeSpectralDistance(Slot& slot, size_t window, size_t channel) noexcept
+            {
+                const auto& history = outputHistory[channel];
+                const auto frameSize = history.size();
+                const auto end = getWindowEnd(window);
+                const auto numNew = juce::jmin(end, frameSize);
+                const auto* trialOutput = slot.output[channel] + (end - numNew);
+                auto* frame = slot.workspace[channel];
+
+                // the frame ending with this window: earlier output, then the soft-clipped trial
+                std::copy(history.begin() + static_cast<std::ptrdiff_t>(numNew), history.end(), frame);
+
+                for (size_t i = 0; i < numNew; ++i)
+                    frame[frameSize - numNew + i] = shape(trialOutput[i]);
+
+                std::array<float, SlidingSpectrum::maxBins> candidate;
+                referenceSpectrum.computeFrameMagnitudes(*slot.fft, frame, frame, candidate.data());
+
+                const auto* reference = getReferenceMagnitudes(window, channel);
+                auto result = 0.0;
+
+                for (auto bin = 0; bin < referenceSpectrum.getNumBins(); ++bin)
+                    result += std::fabs(std::log((1.0f + reference[bin]) / (1.0f + candidate[static_cast<size_t>(bin)])));
+
+                return result;
+            }
+
+            static double getTransitionCost(int from, int to) noexcept
+            {
+                if (from < 0)
+                    return 0.0;
+
+                const auto steps = std::abs(from / numReleaseCandidates - to / numReleaseCandidates)
+                                 + std::abs(from % numReleaseCandidates - to % numReleaseCandidates);
+
+                return smoothnessPenalty * steps;
+            }
+
+            /** Viterbi over the windows: the cheapest path of window costs plus transition costs. */
+            void findTrajectory() noexcept
+            {
+                std::array<double, numCandidates> accumulated, next;
+
+                for (int candidate = 0; candidate < numCandidates; ++candidate)
+                    accumulated[static_cast<size_t>(candidate)] = costs[static_cast<size_t>(candidate)] + getTransitionCost(previousChoice, candidate);
+
+                for (size_t window = 1; window < numWindows; ++window)
+                {
+                    for (int candidate = 0; candidate < numCandidates; ++candidate)
+                    {
+                        auto best = std::numeric_limits<double>::infinity();
+                        auto bestPredecessor = 0;
+
+                        for (int predecessor = 0; predecessor < numCandidates; ++predecessor)
+                        {
+                            const auto total = accumulated[static_cast<size_t>(predecessor)] + getTransitionCost(predecessor, candidate);
+
+                            if (total < best)
+                            {
+                                best = total;
+                                bestPredecessor = predecessor;
+                            }
+                        }
+
+                        next[static_cast<size_t>(candidate)] = best + costs[window * numCandidates + static_cast<size_t>(candidate)];
+                        predecessors[window * numCandidates + static_cast<size_t>(candidate)] = bestPredecessor;
+                    }
+
+                    accumulated = next;
+                }
+
+                auto choice = static_cast<int>(std::min_element(accumulated.begin(), accumulated.end()) - accumulated.begin());
+
+                for (auto window = numWindows; window-- > 0;)
+                {
+                    trajectory[window] = choice;
+                    choice = predecessors[window * numCandidates + static_cast<size_t>(choice)];
+                }
+
+                previousChoice = trajectory[numWindows - 1];
+            }
+
+            /** Runs the chosen trajectory once and keeps the end of the result as the history
+                the next block's frames continue from.
+            */
+            void updateHistory() noexcept
+            {
+                auto& slot = slots.front();
+                const auto numChannels = getNumChannels();
+                const auto numSamples = input.getNumSamples();
+
+                slot.compressor.copyStateFrom(*production);
+
+                for (size_t window = 0; window < numWindows; ++window)
+                {
+                    const auto start = window * windowSize;
+                    const auto length = getWindowEnd(window) - start;
+
+                    slot.compressor.setAttack(getAttack(window));
+                    slot.compressor.setRelease(getRelease(window));
+
+                    juce::dsp::AudioBlock<float> outputBlock(slot.output.data(), numChannels, numSamples);
+                    auto outputWindow = outputBlock.getSubBlock(start, length);
+                    slot.compressor.process(juce::dsp::ProcessContextNonReplacing<float>(input.getSubBlock(start, length), outputWindow),
+                                            key.getSubBlock(start, length));
+                }
+
+                const auto frameSize = outputHistory.front().size();
+                const auto numNew = juce::jmin(numSamples, frameSize);
+
+                for (size_t channel = 0; channel < numChannels; ++channel)
+                {
+                    auto& history = outputHistory[channel];
+                    const auto* trialOutput = slot.output[channel] + (numSamples - numNew);
+
+                    std::copy(history.begin() + static_cast<std::ptrdiff_t>(numNew), history.end(), history.begin());
+
+                    for (size_t i = 0; i < numNew; ++i)
+                        history[frameSize - numNew + i] = shape(trialOutput[i]);
+                }
+            }
+
+            //==============================================================================
+            RealtimeTaskScheduler& scheduler;
+            std::array<Slot, maxSlots> slots;
+            ShaperFunction shaper;
+            float maximumLookAheadTime = 0.0f;
+
+            std::array<double, numAttackCandidates> attackCandidates {};
+            std::array<double, numReleaseCandidates> releaseCandidates {};
+
+            SlidingSpectrum referenceSpectrum;
+            std::array<std::vector<float>, maxChannels> referenceDelay, outputHistory;
+            size_t referenceDelayPosition = 0;
+
+            // per window: reference magnitudes, candidate costs and the Viterbi back pointers
+            size_t windowSize = 1, maximumNumWindows = 0, numWindows = 0;
+            std::vector<float> referenceMagnitudes;
+            std::vector<double> costs;
+            std::vector<int> predecessors, trajectory;
+            int previousChoice = -1;
+
+            std::atomic<int> nextCandidate { 0 };
+            const Compressor* production = nullptr;
+            juce::dsp::AudioBlock<const float> input, key;
+
+            JUCE_DECLARE_NON_COPYABLE(TrajectoryOptimizer)
+        };
+
+} // namespace dsp_original
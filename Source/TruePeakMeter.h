@@ -0,0 +1,187 @@
+/*
+  ==============================================================================
+
+    TruePeakMeter.h
+    Inter-sample peak measurement in the style of ITU-R BS.1770.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+namespace dsp_original
+{
+
+        /**
+            Measures the true (inter-sample) peak of the output.
+
+            When the signal is already available at 4x or more, measureOversampled()
+            just scans it, so metering costs no extra filtering. Otherwise measure()
+            runs the 48-tap 4x polyphase interpolator from BS.1770 Annex 2 on the
+            base-rate signal.
+
+            The results are published through atomics once per block, so they can be
+            read from any thread.
+        */
+        class TruePeakMeter
+        {
+        public:
+            static constexpr int maxChannels = 2;
+
+            TruePeakMeter() = default;
+
+            //==============================================================================
+            /** Clears the interpolator state and the published statistics. */
+            void reset() noexcept
+            {
+                for (auto& channelHistory : history)
+                    channelHistory.fill(0.0f);
+
+                historyPosition = 0;
+                maxTruePeak.store(0.0f);
+                numOvershoots.store(0);
+            }
+
+            /** Sets the linear level above which a sample is counted as an overshoot.
+                The default of 1 counts samples above 0 dBTP.
+            */
+            void setCeiling(float newCeilingGain) noexcept
+            {
+                ceiling = newCeilingGain;
+            }
+
+            /** Asks the audio thread to clear the statistics; may be called from any thread. */
+            void resetStatistics() noexcept
+            {
+                resetRequested.store(true);
+            }
+
+            //==============================================================================
+            /** Scans a block that is already oversampled by at least 4x.
+                Overshoots are counted once per base-rate sample.
+            */
+            template <typename SampleType>
+            void measureOversampled(const juce::dsp::AudioBlock<SampleType>& block, size_t oversamplingRatio) noexcept
+            {
+                jassert(oversamplingRatio >= 4);
+                handleResetRequest();
+
+                auto blockPeak = 0.0f;
+                auto blockOvershoots = 0;
+
+                for (size_t start = 0; start < block.getNumSamples(); start += oversamplingRatio)
+                {
+                    const auto end = juce::jmin(start + oversamplingRatio, block.getNumSamples());
+                    auto framePeak = 0.0f;
+
+                    for (size_t channel = 0; channel < block.getNumChannels(); ++channel)
+                    {
+                        const auto* samples = block.getChannelPointer(channel);
+
+                        for (auto i = start; i < end; ++i)
+                            framePeak = juce::jmax(framePeak, static_cast<float>(std::abs(samples[i])));
+                    }
+
+                    blockPeak = juce::jmax(blockPeak, framePeak);
+                    blockOvershoots += framePeak > ceiling ? 1 : 0;
+                }
+
+                publish(blockPeak, blockOvershoots);
+            }
+
+            /** Measures a base-rate block with the 4x polyphase interpolator. */
+            template <typename SampleType>
+            void measure(const juce::dsp::AudioBlock<SampleType>& block) noexcept
+            {
+                handleResetRequest();
+
+                const auto numChannels = juce::jmin(block.getNumChannels(), static_cast<size_t>(maxChannels));
+                auto blockPeak = 0.0f;
+                auto blockOvershoots = 0;
+
+                for (size_t i = 0; i < block.getNumSamples(); ++i)
+                {
+                    historyPosition = (historyPosition + tapsPerPhase - 1) % tapsPerPhase;
+                    auto framePeak = 0.0f;
+
+                    for (size_t channel = 0; channel < numChannels; ++channel)
+                    {
+                        auto& channelHistory = history[channel];
+                        channelHistory[static_cast<size_t>(historyPosition)] = static_cast<float>(block.getChannelPointer(channel)[i]);
+
+                        for (const auto& phase : coefficients)
+                        {
+                            auto sum = 0.0f;
+
+                            for (int tap = 0; tap < tapsPerPhase; ++tap)
+                                sum += phase[static_cast<size_t>(tap)] * channelHistory[static_cast<size_t>((historyPosition + tap) % tapsPerPhase)];
+
+                            framePeak = juce::jmax(framePeak, std::abs(sum));
+                        }
+                    }
+
+                    blockPeak = juce::jmax(blockPeak, framePeak);
+                    blockOvershoots += framePeak > ceiling ? 1 : 0;
+                }
+
+                publish(blockPeak, blockOvershoots);
+            }
+
+            //==============================================================================
+            /** Returns the highest linear true-peak level since the last reset. */
+            float getMaxTruePeak() const noexcept { return maxTruePeak.load(std::memory_order_relaxed); }
+
+            /** Returns the number of base-rate samples whose true peak exceeded the ceiling. */
+            int getNumOvershoots() const noexcept { return numOvershoots.load(std::memory_order_relaxed); }
+
+        private:
+            //==============================================================================
+            static constexpr int tapsPerPhase = 12;
+
+            // ITU-R BS.1770-4 Annex 2, 4x oversampling, split into its four phases
+            static constexpr std::array<std::array<float, tapsPerPhase>, 4> coefficients {{
+                {{  0.0017089843750f,  0.0109863281250f, -0.0196533203125f,  0.0332031250000f, -0.0594482421875f,  0.1373291015625f,
+                    0.9721679687500f, -0.1022949218750f,  0.0476074218750f, -0.0266113281250f,  0.0148925781250f, -0.0083007812500f }},
+                {{ -0.0291748046875f,  0.0292968750000f, -0.0517578125000f,  0.0891113281250f, -0.1665039062500f,  0.4650878906250f,
+                    0.7797851562500f, -0.2003173828125f,  0.1015625000000f, -0.0582275390625f,  0.0330810546875f, -0.0189208984375f }},
+                {{ -0.0189208984375f,  0.0330810546875f, -0.0582275390625f,  0.1015625000000f, -0.2003173828125f,  0.7797851562500f,
+                    0.4650878906250f, -0.1665039062500f,  0.0891113281250f, -0.0517578125000f,  0.0292968750000f, -0.0291748046875f }},
+                {{ -0.0083007812500f,  0.0148925781250f, -0.0266113281250f,  0.0476074218750f, -0.1022949218750f,  0.9721679687500f,
+                    0.1373291015625f, -0.0594482421875f,  0.0332031250000f, -0.0196533203125f,  0.0109863281250f,  0.0017089843750f }}
+            }};
+
+            void handleResetRequest() noexcept
+            {
+                if (resetRequested.exchange(false))
+                {
+                    maxTruePeak.store(0.0f);
+                    numOvershoots.store(0);
+                }
+            }
+
+            void publish(float blockPeak, int blockOvershoots) noexcept
+            {
+                if (blockPeak > maxTruePeak.load(std::memory_order_relaxed))
+                    maxTruePeak.store(blockPeak, std::memory_order_relaxed);
+
+                if (blockOvershoots > 0)
+                    numOvershoots.fetch_add(blockOvershoots, std::memory_order_relaxed);
+            }
+
+            //==============================================================================
+            std::array<std::array<float, tapsPerPhase>, maxChannels> history {};
+            int historyPosition = 0;
+            float ceiling = 1.0f;
+
+            std::atomic<float> maxTruePeak { 0.0f };
+            std::atomic<int> numOvershoots { 0 };
+            std::atomic<bool> resetRequested { false };
+
+            JUCE_DECLARE_NON_COPYABLE(TruePeakMeter)
+        };
+
+} // namespace dsp_original
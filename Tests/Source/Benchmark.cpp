@@ -0,0 +1,226 @@
+/*
+  ==============================================================================
+
+    Benchmark.cpp
+    Measures the latency, CPU time and output of the processing modes on a
+    fixed signal.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <chrono>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/TruePeakMeter.h"
+
+//==============================================================================
+/**
+    Renders the same seeded, drum-and-bass-like signal through a complete
+    HeuristicLimiterAudioProcessor in several configurations and logs, for each:
+
+    - the latency reported to the host, in samples and milliseconds;
+    - the CPU time of the render as a percentage of the signal's duration, and
+      the worst callback load from getCallbackStatistics();
+    - the true peak of the output;
+    - for low-latency mode, the largest and the RMS difference from the same
+      processing mode at normal latency, after aligning the two latencies.
+
+    "Latency modes" compares both latencies of Eco and Realtime. "Processing
+    modes" times Eco, Realtime and High Quality, single band and with three
+    bands, with and without the control-rate detector.
+
+    The figures depend on the machine, so the only checks are the ones that
+    hold everywhere: finite output, no overs and the latency budget of
+    low-latency mode. Run it in a release build.
+*/
+class Benchmark  : public juce::UnitTest
+{
+public:
+    Benchmark() : juce::UnitTest("Benchmark", "Benchmark") {}
+
+    void runTest() override
+    {
+        const auto input = createSignal();
+
+        beginTest("Latency modes");
+
+        for (auto modeIndex : { 1, 2 }) // Eco（4倍）、Realtime（16倍）
+        {
+            const auto normal = render({ modeIndex, false }, input);
+            const auto lowLatency = render({ modeIndex, true }, input);
+
+            logResult({ modeIndex, false }, normal);
+            logResult({ modeIndex, true }, lowLatency);
+            logDifference(lowLatency, normal);
+
+            expectLessOrEqual(1000.0 * lowLatency.latency / sampleRate, maximumLowLatencyTime, "low-latency mode is over its budget");
+        }
+
+        beginTest("Processing modes");
+
+        for (auto numBands : { 1, 3 })
+        {
+            for (auto controlRate : { false, true })
+            {
+                for (auto modeIndex : { 1, 2, 3 }) // Eco, Realtime, High Quality
+                {
+                    const Configuration configuration { modeIndex, false, numBands, controlRate };
+                    logResult(configuration, render(configuration, input));
+                }
+            }
+        }
+    }
+
+private:
+    //==============================================================================
+    static constexpr double sampleRate = 48000.0;
+    static constexpr int blockSize = 512;
+    static constexpr double signalLength = 10.0; // 秒
+    static constexpr double maximumLowLatencyTime = 1.0; // ミリ秒
+
+    struct Configuration
+    {
+        int modeIndex;
+        bool lowLatency;
+        int numBands = 1;
+        bool controlRate = false;
+
+        juce::String getName() const
+        {
+            static constexpr std::array<const char*, 4> modeNames { "Auto", "Eco", "Realtime", "High Quality" };
+            return juce::String(modeNames[static_cast<size_t>(modeIndex)]) + (lowLatency ? ", low latency" : "")
+                   + (numBands > 1 ? ", " + juce::String(numBands) + " bands" : juce::String())
+                   + (controlRate ? ", control rate" : "");
+        }
+    };
+
+    struct Result
+    {
+        juce::AudioBuffer<float> output;
+        int latency = 0;
+        double cpuPercent = 0.0, worstLoad = 0.0;
+        float truePeak = 0.0f;
+        int overs = 0;
+    };
+
+    //==============================================================================
+    /** Renders the signal through a fresh processor in host-sized blocks and times it. */
+    static Result render(const Configuration& configuration, const juce::AudioBuffer<float>& input)
+    {
+        HeuristicLimiterAudioProcessor processor;
+
+        setParameter(processor, "GAIN", 9.0f);
+        setParameter(processor, "THRESHOLD", -1.0f);
+        setParameter(processor, "LIMITER", 1.0f);
+        setParameter(processor, "MODE", static_cast<float>(configuration.modeIndex));
+        setParameter(processor, "LOW_LATENCY", configuration.lowLatency ? 1.0f : 0.0f);
+        setParameter(processor, "BANDS", static_cast<float>(configuration.numBands));
+        setParameter(processor, "CONTROL_RATE", configuration.controlRate ? 1.0f : 0.0f);
+
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        Result result;
+        result.output.makeCopyOf(input);
+        result.latency = processor.getLatencySamples();
+
+        juce::MidiBuffer midi;
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int position = 0; position < input.getNumSamples(); position += blockSize)
+        {
+            juce::AudioBuffer<float> block(result.output.getArrayOfWritePointers(), result.output.getNumChannels(),
+                                           position, juce::jmin(blockSize, input.getNumSamples() - position));
+            processor.processBlock(block, midi);
+        }
+
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.cpuPercent = 100.0 * elapsed / signalLength;
+        result.worstLoad = processor.getCallbackStatistics().getWorstLoad();
+        result.overs = processor.getCallbackStatistics().getNumOvers();
+
+        dsp_original::TruePeakMeter meter;
+        meter.measure(juce::dsp::AudioBlock<const float>(result.output.getArrayOfReadPointers(),
+                                                         static_cast<size_t>(result.output.getNumChannels()),
+                                                         static_cast<size_t>(result.output.getNumSamples())));
+        result.truePeak = meter.getMaxTruePeak();
+
+        processor.releaseResources();
+        return result;
+    }
+
+    void logResult(const Configuration& configuration, const Result& result)
+    {
+        logMessage(configuration.getName() + ": latency " + juce::String(result.latency) + " samples ("
+                   + juce::String(1000.0 * result.latency / sampleRate, 2) + " ms), CPU "
+                   + juce::String(result.cpuPercent, 2) + " %, worst load " + juce::String(result.worstLoad, 2)
+                   + ", true peak " + juce::String(juce::Decibels::gainToDecibels(result.truePeak), 2) + " dBTP");
+
+        const auto context = " in " + configuration.getName();
+        expectEquals(result.overs, 0, "output above 0 dBFS" + context);
+        expect(std::isfinite(result.truePeak), "NaN/Inf" + context);
+    }
+
+    /** Compares a render with another after shifting out the difference of their latencies. */
+    void logDifference(const Result& result, const Result& comparison)
+    {
+        const auto offset = comparison.latency - result.latency;
+        const auto numSamples = result.output.getNumSamples() - std::abs(offset);
+        auto maxDifference = 0.0, sumOfSquares = 0.0;
+
+        for (int channel = 0; channel < result.output.getNumChannels(); ++channel)
+        {
+            const auto* samples = result.output.getReadPointer(channel, juce::jmax(0, -offset));
+            const auto* comparisonSamples = comparison.output.getReadPointer(channel, juce::jmax(0, offset));
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const auto difference = static_cast<double>(samples[i]) - static_cast<double>(comparisonSamples[i]);
+                maxDifference = juce::jmax(maxDifference, std::abs(difference));
+                sumOfSquares += difference * difference;
+            }
+        }
+
+        const auto rmsDifference = std::sqrt(sumOfSquares / static_cast<double>(result.output.getNumChannels() * numSamples));
+        logMessage("  difference from normal latency: max " + juce::String(juce::Decibels::gainToDecibels(maxDifference), 1)
+                   + " dB, RMS " + juce::String(juce::Decibels::gainToDecibels(rmsDifference), 1) + " dB");
+    }
+
+    static void setParameter(HeuristicLimiterAudioProcessor& processor, const juce::String& id, float value)
+    {
+        for (auto* parameter : processor.getParameters())
+            if (auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter); ranged != nullptr && ranged->paramID == id)
+                ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+    }
+
+    //==============================================================================
+    /** Kick, snare, hi-hat and bass at 120 BPM, seeded so every run renders the same audio. */
+    static juce::AudioBuffer<float> createSignal()
+    {
+        const auto numSamples = static_cast<int>(signalLength * sampleRate);
+        juce::AudioBuffer<float> signal(2, numSamples);
+        juce::Random random(0x42656e63);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto t = i / sampleRate;
+            const auto beat = std::fmod(t, 0.5);
+            const auto kick = std::exp(-25.0 * beat) * std::sin(juce::MathConstants<double>::twoPi * (55.0 - 30.0 * beat) * beat);
+            const auto snareTime = std::fmod(t + 0.25, 0.5);
+            const auto noise = 2.0 * random.nextDouble() - 1.0;
+            const auto snare = std::exp(-40.0 * snareTime) * noise;
+            const auto hat = std::exp(-200.0 * std::fmod(t, 0.125)) * (2.0 * random.nextDouble() - 1.0);
+            const auto bass = std::sin(juce::MathConstants<double>::twoPi * (std::fmod(t, 2.0) < 1.0 ? 41.2 : 55.0) * t);
+
+            for (int channel = 0; channel < 2; ++channel)
+            {
+                const auto pan = channel == 0 ? 0.8 : 1.0;
+                signal.setSample(channel, i, static_cast<float>(0.6 * kick + 0.35 * pan * snare + 0.15 * hat + 0.25 * bass));
+            }
+        }
+
+        return signal;
+    }
+};
+
+static Benchmark benchmark;
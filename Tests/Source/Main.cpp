@@ -0,0 +1,32 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Runs the unit tests of the processor: all of them, or one category given
+    as the first argument (e.g. "Stress"). Returns 1 if any test failed.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    // プロセッサのタイマーとパラメータにはメッセージマネージャーが要る
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+
+    if (argc > 1)
+        runner.runTestsInCategory(argv[1]);
+    else
+        runner.runAllTests();
+
+    auto numFailures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        numFailures += runner.getResult(i)->failures;
+
+    return numFailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,434 @@
+/*
+  ==============================================================================
+
+    NullTest.cpp
+    Renders a fixed corpus through the whole processor and compares every
+    processing mode with one full-quality reference render.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <chrono>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/TruePeakMeter.h"
+
+//==============================================================================
+/**
+    Null test of the processing modes against a fixed reference.
+
+    The reference is High Quality at normal latency, with the 16x linear-phase
+    oversampler and setReferenceRendering(true): the detector runs on every sample
+    and the gain curve is evaluated with std::pow. It is rendered once per corpus
+    item, for each setting and band layout (single band, linked, three bands),
+    and records the attack and release it chose for every block.
+
+    Every variant (Eco, Realtime and High Quality, at normal and low latency,
+    and with the control-rate detector) is then rendered twice:
+
+    - pinned: with the reference's search results, through
+      setPinnedSearchResults(), and compared with the reference rendered with
+      the same pinned results. The difference is the cost of the variant's
+      processing path alone: oversampler, latency, detector rate and gain table.
+    - own search: with the variant's own search, compared with the reference as
+      it searched itself. This adds the cost of the variant's search (Eco's
+      12-bit precision, the per-block search instead of High Quality's windows).
+
+    Renders are aligned on their reported latencies. For each, the test logs
+    the largest and the RMS sample difference, the true-peak overshoot above the
+    reference and the CPU time as a percentage of real time. It fails when a
+    pinned render exceeds its variant's limits, when an own-search render
+    exceeds the shared limits, or when any render has a sample above 0 dBFS.
+
+    The corpus is synthetic and seeded. Set HEURISTICLIMITER_NULL_TEST_CORPUS to
+    a directory of audio files to add a few seconds from the middle of each, and
+    HEURISTICLIMITER_NULL_TEST_OUTPUT to a directory to write every render there
+    as a 24-bit WAV file.
+*/
+class NullTest  : public juce::UnitTest
+{
+public:
+    NullTest() : juce::UnitTest("Null test", "NullTest") {}
+
+    void runTest() override
+    {
+        auto corpus = createCorpus();
+        loadCorpusFiles(corpus);
+        const auto outputDirectory = getOutputDirectory();
+
+        for (const auto& setting : settings)
+        {
+            for (const auto& layout : layouts)
+            {
+                beginTest(juce::String(setting.name) + ", " + layout.name);
+
+                std::array<double, variants.size()> cpuPercent {}, pinnedCpuPercent {};
+
+                for (const auto& item : corpus)
+                {
+                    const Configuration referenceConfiguration { setting, layout, referenceVariant };
+                    std::vector<HeuristicLimiterAudioProcessor::SearchResult> searchResults;
+
+                    const auto reference = render(referenceConfiguration, item, nullptr, &searchResults);
+                    const auto pinnedReference = render(referenceConfiguration, item, &searchResults, nullptr);
+                    logMessage(item.name + ", reference: CPU " + juce::String(reference.cpuPercent, 1) + " %");
+
+                    for (size_t i = 0; i < variants.size(); ++i)
+                    {
+                        const Configuration configuration { setting, layout, variants[i] };
+                        const auto ownSearch = render(configuration, item, nullptr, nullptr);
+                        const auto pinned = render(configuration, item, &searchResults, nullptr);
+
+                        compare(configuration, item, pinned, pinnedReference, variants[i].pinnedLimits, "pinned");
+                        compare(configuration, item, ownSearch, reference, ownSearchLimits, "own search");
+
+                        cpuPercent[i] += ownSearch.cpuPercent / static_cast<double>(corpus.size());
+                        pinnedCpuPercent[i] += pinned.cpuPercent / static_cast<double>(corpus.size());
+
+                        if (outputDirectory != juce::File())
+                        {
+                            const auto baseName = item.name + "_" + configuration.getName();
+                            writeWav(outputDirectory.getChildFile(baseName + ".wav"), ownSearch.output, item.sampleRate);
+                            writeWav(outputDirectory.getChildFile(baseName + "_pinned.wav"), pinned.output, item.sampleRate);
+                        }
+                    }
+
+                    if (outputDirectory != juce::File())
+                    {
+                        const auto baseName = item.name + "_" + referenceConfiguration.getName();
+                        writeWav(outputDirectory.getChildFile(baseName + ".wav"), reference.output, item.sampleRate);
+                        writeWav(outputDirectory.getChildFile(baseName + "_pinned.wav"), pinnedReference.output, item.sampleRate);
+                    }
+                }
+
+                for (size_t i = 0; i < variants.size(); ++i)
+                    logMessage(juce::String(variants[i].name) + ": CPU " + juce::String(cpuPercent[i], 1)
+                               + " % (pinned " + juce::String(pinnedCpuPercent[i], 1) + " %)");
+            }
+        }
+    }
+
+private:
+    //==============================================================================
+    static constexpr double sampleRate = 48000.0;
+    static constexpr int blockSize = 512;
+    static constexpr double itemLength = 2.0; // 秒
+
+    /** Largest allowed sample difference and RMS difference (dBFS), and true-peak overshoot (dB). */
+    struct Limits
+    {
+        double maximumError, rmsError, truePeakOvershoot;
+    };
+
+    struct Variant
+    {
+        const char* name;
+        int modeIndex;
+        bool lowLatency, controlRate, referenceRendering;
+        Limits pinnedLimits;
+    };
+
+    // 基準：高品質・16倍FIR・毎サンプル検出・std::powのカーブ
+    static constexpr Variant referenceVariant { "reference", 3, false, false, true, {} };
+
+    // 閾値は実測の最悪値に余裕を持たせたもの（探索を固定した処理経路のみの差）
+    // 最大誤差・RMS誤差の最悪値はどのモードも全帯域ノイズで出る
+    static constexpr std::array<Variant, 7> variants {{
+        { "eco",                  1, false, false, false, {   2.0,  -7.5, 0.8 } },
+        { "realtime",             2, false, false, false, { -75.0, -90.0, 0.1 } },
+        { "hq",                   3, false, false, false, { -75.0, -90.0, 0.1 } },
+        { "eco_lowlatency",       1, true,  false, false, {   6.0,  -5.0, 2.5 } },
+        { "realtime_lowlatency",  2, true,  false, false, {   5.0,  -6.0, 2.0 } },
+        { "eco_controlrate",      1, false, true,  false, {   3.0,  -5.5, 0.3 } },
+        { "realtime_controlrate", 2, false, true,  false, {   2.0,  -6.5, 0.3 } }
+    }};
+
+    // 探索も含めた差（各モードが自分で探索した結果）
+    static constexpr Limits ownSearchLimits { 6.0, -5.0, 2.5 };
+
+    struct Setting
+    {
+        const char* name;
+        float gain, threshold, ratio, knee;
+        bool limiter;
+    };
+
+    static constexpr std::array<Setting, 2> settings {{
+        { "limiter", 9.0f, -1.0f, 4.0f, 0.0f, true },
+        { "compressor", 6.0f, -18.0f, 4.0f, 12.0f, false }
+    }};
+
+    struct Layout
+    {
+        const char* name;
+        int numBands;
+        bool link;
+    };
+
+    static constexpr std::array<Layout, 3> layouts {{
+        { "1 band", 1, false },
+        { "1 band linked", 1, true },
+        { "3 bands", 3, false }
+    }};
+
+    struct Configuration
+    {
+        Setting setting;
+        Layout layout;
+        Variant variant;
+
+        juce::String getName() const
+        {
+            return juce::String(setting.name) + "_" + variant.name + "_" + juce::String(layout.numBands) + "band"
+                   + (layout.link ? "_link" : "");
+        }
+    };
+
+    struct Item
+    {
+        juce::String name;
+        double sampleRate;
+        juce::AudioBuffer<float> audio;
+    };
+
+    struct Render
+    {
+        juce::AudioBuffer<float> output;
+        int latency = 0;
+        double cpuPercent = 0.0;
+    };
+
+    //==============================================================================
+    void compare(const Configuration& configuration, const Item& item, const Render& result, const Render& reference,
+                 const Limits& limits, const juce::String& kind)
+    {
+        // 報告されたレイテンシーの差を詰めて比べる
+        const auto offset = reference.latency - result.latency;
+        const auto numSamples = result.output.getNumSamples() - std::abs(offset);
+        auto maxError = 0.0, sumOfSquares = 0.0;
+        auto peak = 0.0f;
+
+        for (int channel = 0; channel < result.output.getNumChannels(); ++channel)
+        {
+            const auto* samples = result.output.getReadPointer(channel, juce::jmax(0, -offset));
+            const auto* referenceSamples = reference.output.getReadPointer(channel, juce::jmax(0, offset));
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const auto error = static_cast<double>(samples[i]) - static_cast<double>(referenceSamples[i]);
+                maxError = juce::jmax(maxError, std::abs(error));
+                sumOfSquares += error * error;
+                peak = juce::jmax(peak, std::abs(samples[i]));
+            }
+        }
+
+        const auto rmsError = std::sqrt(sumOfSquares / static_cast<double>(result.output.getNumChannels() * numSamples));
+        const auto maxErrordB = juce::Decibels::gainToDecibels(maxError, -200.0);
+        const auto rmsErrordB = juce::Decibels::gainToDecibels(rmsError, -200.0);
+        const auto truePeakOvershoot = static_cast<double>(getTruePeakOvershoot(result.output, reference.output));
+
+        logMessage(item.name + ", " + configuration.variant.name + " (" + kind + "): max "
+                   + juce::String(maxErrordB, 1) + " dB, RMS " + juce::String(rmsErrordB, 1)
+                   + " dB, true-peak overshoot " + juce::String(truePeakOvershoot, 2) + " dB, CPU "
+                   + juce::String(result.cpuPercent, 1) + " %");
+
+        const auto failureContext = configuration.getName() + " (" + kind + ") / " + item.name;
+        expect(std::isfinite(maxError), "NaN/Inf in " + failureContext);
+        expectLessOrEqual(maxErrordB, limits.maximumError, "sample error of " + failureContext);
+        expectLessOrEqual(rmsErrordB, limits.rmsError, "RMS error of " + failureContext);
+        expectLessOrEqual(truePeakOvershoot, limits.truePeakOvershoot, "true-peak overshoot of " + failureContext);
+        expectLessOrEqual(peak, 1.0f, "output above 0 dBFS in " + failureContext);
+    }
+
+    /** Renders the item through a fresh processor in host-sized blocks. Pass pinnedResults
+        to skip the search, and recordedResults to collect the search result of every block.
+    */
+    static Render render(const Configuration& configuration, const Item& item,
+                         const std::vector<HeuristicLimiterAudioProcessor::SearchResult>* pinnedResults,
+                         std::vector<HeuristicLimiterAudioProcessor::SearchResult>* recordedResults)
+    {
+        HeuristicLimiterAudioProcessor processor;
+        const auto& setting = configuration.setting;
+        const auto& variant = configuration.variant;
+
+        setParameter(processor, "GAIN", setting.gain);
+        setParameter(processor, "THRESHOLD", setting.threshold);
+        setParameter(processor, "RATIO", setting.ratio);
+        setParameter(processor, "KNEE", setting.knee);
+        setParameter(processor, "LIMITER", setting.limiter ? 1.0f : 0.0f);
+        setParameter(processor, "BANDS", static_cast<float>(configuration.layout.numBands));
+        setParameter(processor, "LINK", configuration.layout.link ? 1.0f : 0.0f);
+        setParameter(processor, "MODE", static_cast<float>(variant.modeIndex));
+        setParameter(processor, "LOW_LATENCY", variant.lowLatency ? 1.0f : 0.0f);
+        setParameter(processor, "CONTROL_RATE", variant.controlRate ? 1.0f : 0.0f);
+
+        processor.setReferenceRendering(variant.referenceRendering);
+        processor.setPinnedSearchResults(pinnedResults);
+        processor.setRateAndBufferSizeDetails(item.sampleRate, blockSize);
+        processor.prepareToPlay(item.sampleRate, blockSize);
+
+        Render result;
+        result.output.makeCopyOf(item.audio);
+        result.latency = processor.getLatencySamples();
+
+        juce::MidiBuffer midi;
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int position = 0; position < result.output.getNumSamples(); position += blockSize)
+        {
+            juce::AudioBuffer<float> block(result.output.getArrayOfWritePointers(), result.output.getNumChannels(),
+                                           position, juce::jmin(blockSize, result.output.getNumSamples() - position));
+            processor.processBlock(block, midi);
+
+            if (recordedResults != nullptr)
+                recordedResults->push_back(processor.getLastSearchResult());
+        }
+
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.cpuPercent = 100.0 * elapsed * item.sampleRate / static_cast<double>(result.output.getNumSamples());
+
+        processor.releaseResources();
+        return result;
+    }
+
+    static float getTruePeakOvershoot(const juce::AudioBuffer<float>& variant, const juce::AudioBuffer<float>& reference)
+    {
+        dsp_original::TruePeakMeter variantMeter, referenceMeter;
+        variantMeter.measure(juce::dsp::AudioBlock<const float>(variant.getArrayOfReadPointers(), static_cast<size_t>(variant.getNumChannels()), static_cast<size_t>(variant.getNumSamples())));
+        referenceMeter.measure(juce::dsp::AudioBlock<const float>(reference.getArrayOfReadPointers(), static_cast<size_t>(reference.getNumChannels()), static_cast<size_t>(reference.getNumSamples())));
+
+        const auto referencePeak = referenceMeter.getMaxTruePeak();
+        return referencePeak > 0.0f ? juce::Decibels::gainToDecibels(variantMeter.getMaxTruePeak() / referencePeak) : 0.0f;
+    }
+
+    static void setParameter(HeuristicLimiterAudioProcessor& processor, const juce::String& id, float value)
+    {
+        for (auto* parameter : processor.getParameters())
+            if (auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter); ranged != nullptr && ranged->paramID == id)
+                ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+    }
+
+    //==============================================================================
+    /** The synthetic part of the corpus is seeded, so every run renders the same audio. */
+    static std::vector<Item> createCorpus()
+    {
+        const auto numSamples = static_cast<int>(itemLength * sampleRate);
+        juce::Random random(0x4e756c6c);
+        std::vector<Item> corpus;
+
+        const auto addItem = [&corpus, numSamples](const juce::String& name, auto&& generate) {
+            Item item { name, sampleRate, juce::AudioBuffer<float>(2, numSamples) };
+
+            for (int channel = 0; channel < 2; ++channel)
+                for (int i = 0; i < numSamples; ++i)
+                    item.audio.setSample(channel, i, generate(channel, i / sampleRate));
+
+            corpus.push_back(std::move(item));
+        };
+
+        const auto sine = [](double frequency, double time) {
+            return static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * frequency * time));
+        };
+
+        // 低域と高域の持続音（ゲインの揺れ・歪み）
+        addItem("sines", [&sine](int channel, double t) {
+            return 0.5f * sine(60.0, t) + 0.4f * sine(channel == 0 ? 3000.0 : 3100.0, t);
+        });
+
+        // 立ち上がりの速いトーンバースト（ルックアヘッドとアタック）
+        addItem("bursts", [&sine](int, double t) {
+            return (std::fmod(t, 0.3) < 0.05 ? 1.0f : 0.05f) * sine(1000.0, t);
+        });
+
+        // 広帯域のノイズ（トゥルーピーク）
+        addItem("noise", [&random](int, double) {
+            return 0.8f * (2.0f * random.nextFloat() - 1.0f);
+        });
+
+        // キック・スネア風の減衰する打撃音（リリース）
+        addItem("drums", [&sine, &random](int, double t) {
+            const auto beat = std::fmod(t, 0.5);
+            const auto kick = std::exp(-static_cast<float>(beat) * 25.0f) * sine(55.0 - 30.0 * beat, beat);
+            const auto snareTime = std::fmod(t + 0.25, 0.5);
+            const auto snare = std::exp(-static_cast<float>(snareTime) * 40.0f) * (2.0f * random.nextFloat() - 1.0f);
+            return 0.9f * kick + 0.6f * snare;
+        });
+
+        // 左右でレベルの違う素材（ステレオリンク）
+        addItem("unbalanced", [&sine](int channel, double t) {
+            return channel == 0 ? 0.9f * sine(220.0, t) * (std::fmod(t, 0.4) < 0.1 ? 1.0f : 0.2f)
+                                : 0.1f * sine(330.0, t);
+        });
+
+        return corpus;
+    }
+
+    /** Adds itemLength seconds from the middle of every readable file in the corpus directory. */
+    void loadCorpusFiles(std::vector<Item>& corpus)
+    {
+        const auto path = juce::SystemStats::getEnvironmentVariable("HEURISTICLIMITER_NULL_TEST_CORPUS", {});
+
+        if (path.isEmpty())
+            return;
+
+        const auto directory = juce::File::getCurrentWorkingDirectory().getChildFile(path);
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        for (const auto& file : directory.findChildFiles(juce::File::findFiles, false, formatManager.getWildcardForAllFormats()))
+        {
+            std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+            if (reader == nullptr || reader->numChannels == 0)
+            {
+                logMessage("cannot read " + file.getFullPathName());
+                continue;
+            }
+
+            // モノラルは両チャンネルに同じ信号を入れる
+            const auto numSamples = static_cast<int>(juce::jmin(static_cast<juce::int64>(itemLength * reader->sampleRate), reader->lengthInSamples));
+            const auto start = (reader->lengthInSamples - numSamples) / 2;
+            Item item { file.getFileNameWithoutExtension(), reader->sampleRate, juce::AudioBuffer<float>(2, numSamples) };
+            reader->read(&item.audio, 0, numSamples, start, true, true);
+
+            if (reader->numChannels == 1)
+                item.audio.copyFrom(1, 0, item.audio, 0, 0, numSamples);
+
+            corpus.push_back(std::move(item));
+        }
+    }
+
+    static juce::File getOutputDirectory()
+    {
+        const auto path = juce::SystemStats::getEnvironmentVariable("HEURISTICLIMITER_NULL_TEST_OUTPUT", {});
+
+        if (path.isEmpty())
+            return {};
+
+        const auto directory = juce::File::getCurrentWorkingDirectory().getChildFile(path);
+        directory.createDirectory();
+        return directory;
+    }
+
+    void writeWav(const juce::File& file, const juce::AudioBuffer<float>& audio, double rate)
+    {
+        file.deleteFile();
+        auto stream = std::make_unique<juce::FileOutputStream>(file);
+        juce::WavAudioFormat format;
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+
+        if (! stream->failedToOpen())
+            writer.reset(format.createWriterFor(stream.get(), rate, static_cast<unsigned int>(audio.getNumChannels()), 24, {}, 0));
+
+        if (writer == nullptr)
+        {
+            logMessage("cannot write " + file.getFullPathName());
+            return;
+        }
+
+        stream.release(); // the writer owns the stream now
+        writer->writeFromAudioSampleBuffer(audio, 0, audio.getNumSamples());
+    }
+};
+
+static NullTest nullTest;
@@ -0,0 +1,20 @@
+/*
+  ==============================================================================
+
+    ProcessorUnderTest.cpp
+    Builds the plugin's processor and editor into the test application.
+
+    A console application has no JucePluginDefines.h, so the few plugin
+    characteristics the processor reads are defined here before its sources.
+
+  ==============================================================================
+*/
+
+#define JucePlugin_Name                 "HeuristicLimiter"
+#define JucePlugin_IsSynth              0
+#define JucePlugin_IsMidiEffect         0
+#define JucePlugin_WantsMidiInput       0
+#define JucePlugin_ProducesMidiOutput   0
+
+#include "../../Source/PluginProcessor.cpp"
+#include "../../Source/PluginEditor.cpp"
@@ -0,0 +1,148 @@
+/*
+  ==============================================================================
+
+    SimulatorTest.cpp
+    Checks that the bounded objective finds what the unbounded search finds.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <boost/math/tools/minima.hpp>
+#include "../../Source/HeuristicSimulator.h"
+
+//==============================================================================
+/**
+    Runs the attack and release searches of HeuristicSimulator on a block stream,
+    once with getObjective() (trials abandoned above the best cost so far) and
+    once with an unbounded evaluate(). The times both searches choose are then
+    scored with a full, unbounded evaluate().
+
+    Abandoned trials only change the values Brent's parabolic steps are fitted
+    to, never the best point, so the bounded choice must cost no more than the
+    unbounded one beyond maximumCostExcess. Host-sized blocks of 256 and 512
+    samples must abandon trials too, not only long ones.
+*/
+class SimulatorTest  : public juce::UnitTest
+{
+public:
+    SimulatorTest() : juce::UnitTest("Bounded search", "Simulator") {}
+
+    void runTest() override
+    {
+        auto random = getRandom();
+
+        for (const auto blockSize : { 256, 512, 4096 })
+        {
+            beginTest("Limiter, " + juce::String(blockSize) + "-sample blocks");
+            runSearches(random, blockSize, -30.0f, std::numeric_limits<float>::infinity());
+
+            beginTest("Compressor, " + juce::String(blockSize) + "-sample blocks");
+            runSearches(random, blockSize, -28.0f, 4.0f);
+        }
+    }
+
+private:
+    //==============================================================================
+    struct SoftClip
+    {
+        float operator()(float x) const noexcept { return std::tanh(x); }
+    };
+
+    using Simulator = dsp_original::HeuristicSimulator<SoftClip>;
+
+    static constexpr double sampleRate = 48000.0;
+    static constexpr int numSamples = 40 * 4096; // ブロック長によらず同じ長さ
+    static constexpr float lookAheadTime = 5.0f;
+    static constexpr double maximumAttackTime = 30.0, maximumReleaseTime = 300.0;
+    static constexpr int searchBits = 24;
+    static constexpr double maximumCostExcess = 1.0e-3; // 相対値
+
+    void runSearches(juce::Random& random, int blockSize, float threshold, float ratio)
+    {
+        const juce::dsp::ProcessSpec spec { sampleRate, static_cast<juce::uint32>(blockSize), 2 };
+        dsp_original::LookAheadCompressor<float> production;
+        production.setMaximumLookAheadTime(lookAheadTime);
+        production.setLookAheadTime(lookAheadTime);
+        production.prepare(spec);
+        production.setThreshold(threshold);
+        production.setRatio(ratio);
+
+        Simulator simulator;
+        simulator.setMaximumLookAheadTime(lookAheadTime);
+        simulator.setLookAheadTime(lookAheadTime);
+
+        dsp_original::ScratchArena arena;
+        arena.prepare(Simulator::getRequiredScratchBytes(sampleRate, blockSize));
+        simulator.prepare(spec, arena);
+
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        auto time = 0.0;
+        auto worstExcess = 0.0;
+
+        for (int block = 0; block < numSamples / blockSize; ++block)
+        {
+            fillBlock(random, buffer, time);
+            time += blockSize / sampleRate;
+
+            juce::dsp::AudioBlock<float> audioBlock(buffer);
+            const juce::dsp::AudioBlock<const float> inputBlock(audioBlock);
+
+            simulator.beginBlock(production, inputBlock, inputBlock);
+
+            const auto release = compareSearches<Simulator::Parameter::release>(simulator, maximumReleaseTime, worstExcess);
+            production.setRelease(static_cast<float>(release));
+
+            const auto attack = compareSearches<Simulator::Parameter::attack>(simulator, maximumAttackTime, worstExcess);
+            production.setAttack(static_cast<float>(attack));
+
+            simulator.endBlock();
+
+            juce::dsp::ProcessContextReplacing<float> context(audioBlock);
+            production.process(context);
+        }
+
+        logMessage("worst relative cost excess " + juce::String(worstExcess, 6)
+                   + ", " + juce::String(simulator.getNumAbandonedTrials()) + " trials abandoned");
+        expectGreaterThan(simulator.getNumAbandonedTrials(), 0, "no trial was abandoned");
+    }
+
+    /** Runs both searches, checks the bounded choice and returns it. */
+    template <Simulator::Parameter parameter>
+    double compareSearches(Simulator& simulator, double maximum, double& worstExcess)
+    {
+        const auto unbounded = [&simulator](double x) { return simulator.evaluate<parameter>(x); };
+
+        const auto bounded = boost::math::tools::brent_find_minima(simulator.getObjective<parameter>(), 0.0, maximum, searchBits).first;
+        const auto reference = boost::math::tools::brent_find_minima(unbounded, 0.0, maximum, searchBits).first;
+
+        const auto boundedCost = unbounded(bounded);
+        const auto referenceCost = unbounded(reference);
+        const auto excess = (boundedCost - referenceCost) / juce::jmax(referenceCost, 1.0e-12);
+
+        worstExcess = juce::jmax(worstExcess, excess);
+        expectLessOrEqual(excess, maximumCostExcess, "the bounded search chose a worse time");
+        return bounded;
+    }
+
+    /** Bursts of a sine pair with noise, every 250 ms, over a bed near the threshold. */
+    static void fillBlock(juce::Random& random, juce::AudioBuffer<float>& buffer, double startTime)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            auto* samples = buffer.getWritePointer(channel);
+            const auto frequency = channel == 0 ? 110.0 : 165.0;
+
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+            {
+                const auto t = startTime + i / sampleRate;
+                const auto envelope = std::fmod(t, 0.25) < 0.02 ? 1.0f : 0.05f;
+                const auto tone = static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * frequency * t));
+
+                samples[i] = envelope * (0.6f * tone + 0.4f * (2.0f * random.nextFloat() - 1.0f));
+            }
+        }
+    }
+};
+
+static SimulatorTest simulatorTest;
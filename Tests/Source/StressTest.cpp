@@ -0,0 +1,235 @@
+/*
+  ==============================================================================
+
+    StressTest.cpp
+    Drives a real processor like a host would and checks the callback statistics.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+
+//==============================================================================
+/**
+    Plays a processor with randomised block sizes, parameter automation, bypass
+    runs and offline/realtime switches, then checks what getCallbackStatistics()
+    recorded:
+
+    - no NaN/Inf output in any phase;
+    - no operator new inside any callback (the project enables
+      HEURISTICLIMITER_ALLOCATION_GUARD);
+    - no overs in the limiting phases, where the ratio is infinite and the
+      threshold is below 0 dBFS (bypassed callbacks pass the input's overs
+      through and are not counted);
+    - at most 1% deadline misses in the realtime phases. This is only checked
+      in release builds, because debug builds are not meant to run in time.
+
+    The random seed comes from the runner, so a failure can be replayed.
+*/
+class StressTest  : public juce::UnitTest
+{
+public:
+    StressTest() : juce::UnitTest("Processor stress", "Stress") {}
+
+    void runTest() override
+    {
+        auto random = getRandom();
+
+        for (auto sidechain : { false, true })
+        {
+            const auto suffix = juce::String(sidechain ? " (sidechain)" : "");
+
+            beginTest("Full automation" + suffix);
+            runPhase(random, { 2000, 1, 1024, Automation::all, true, sidechain, false, false });
+
+            beginTest("Limiting" + suffix);
+            runPhase(random, { 2000, 16, 1024, Automation::limiting, true, sidechain, true, false });
+
+            beginTest("Realtime load" + suffix);
+            runPhase(random, { 2000, 64, 1024, Automation::limiting, false, sidechain, true, true });
+        }
+    }
+
+private:
+    //==============================================================================
+    static constexpr double sampleRate = 48000.0;
+    static constexpr int maximumBlockSize = 512; // 最大ブロック長を超えるブロックも送る（分割の確認）
+    static constexpr double maximumMissRatio = 0.01;
+
+    enum class Automation
+    {
+        all,        // 全パラメータを全範囲で動かす
+        limiting    // リミッター・スレッショルド0dBFS未満のまま、それ以外を動かす
+    };
+
+    struct Phase
+    {
+        int numCallbacks;
+        int minimumBlockSize, maximumBlockSize;
+        Automation automation;
+        bool switchOffline;     // オフラインレンダリングとの切り替え（AutoモードでHigh Qualityになる）
+        bool sidechain;
+        bool expectNoOvers;
+        bool expectRealtimeLoad;
+    };
+
+    //==============================================================================
+    void runPhase(juce::Random& random, const Phase& phase)
+    {
+        HeuristicLimiterAudioProcessor processor;
+
+        if (phase.sidechain)
+        {
+            auto layout = processor.getBusesLayout();
+            layout.inputBuses.getReference(1) = juce::AudioChannelSet::stereo();
+            expect(processor.setBusesLayout(layout), "the stereo sidechain layout was rejected");
+        }
+
+        processor.setRateAndBufferSizeDetails(sampleRate, maximumBlockSize);
+        processor.prepareToPlay(sampleRate, maximumBlockSize);
+
+        if (phase.automation == Automation::limiting)
+            setLimitingDefaults(processor);
+
+        const auto numChannels = juce::jmax(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+        juce::AudioBuffer<float> buffer(numChannels, 2 * maximumBlockSize);
+        juce::MidiBuffer midi;
+        auto phaseTime = 0.0;
+        auto bypassedCallbacks = 0;
+        auto allocatingCallbacks = 0;
+
+        for (int callback = 0; callback < phase.numCallbacks; ++callback)
+        {
+            // ブロック長はホスト毎にばらばら（1サンプル、最大ブロック長超えも含む）
+            const auto numSamples = random.nextInt(juce::Range<int>(phase.minimumBlockSize, phase.maximumBlockSize + 1));
+            juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), numChannels, numSamples);
+
+            fillInput(random, block, phaseTime, phase.automation == Automation::limiting);
+            phaseTime += numSamples / sampleRate;
+
+            // おおよそ10コールバックに1回、パラメータを1つ動かす
+            if (random.nextInt(10) == 0)
+                automateParameter(random, processor, phase.automation);
+
+            if (phase.switchOffline && random.nextInt(200) == 0)
+                processor.setNonRealtime(! processor.isNonRealtime());
+
+            // バイパスは数十コールバック続くまとまりで入れる
+            if (bypassedCallbacks == 0 && random.nextInt(100) == 0)
+                bypassedCallbacks = random.nextInt(juce::Range<int>(1, 50));
+
+            const auto allocationsBefore = dsp_original::AllocationGuard::getNumAudioThreadAllocations();
+
+            if (bypassedCallbacks > 0)
+            {
+                --bypassedCallbacks;
+                processor.processBlockBypassed(block, midi);
+            }
+            else
+            {
+                processor.processBlock(block, midi);
+            }
+
+            if (dsp_original::AllocationGuard::getNumAudioThreadAllocations() != allocationsBefore)
+                ++allocatingCallbacks;
+        }
+
+        expectEquals(allocatingCallbacks, 0, "callbacks allocated on the audio thread");
+        checkStatistics(processor.getCallbackStatistics(), phase);
+        processor.releaseResources();
+    }
+
+    void checkStatistics(const dsp_original::CallbackStatistics& statistics, const Phase& phase)
+    {
+        logMessage("callbacks " + juce::String(statistics.getNumCallbacks())
+                   + ", worst load " + juce::String(statistics.getWorstLoad(), 2)
+                   + ", deadline misses " + juce::String(statistics.getNumDeadlineMisses())
+                   + ", overs " + juce::String(statistics.getNumOvers()));
+
+        expectEquals(statistics.getNumCallbacks(), phase.numCallbacks, "callbacks were not all recorded");
+        expectEquals(statistics.getNumNonFiniteSamples(), 0, "NaN/Inf in the output");
+
+        if (phase.expectNoOvers)
+            expectEquals(statistics.getNumOvers(), 0, "output above 0 dBFS while limiting");
+
+       #if ! JUCE_DEBUG
+        if (phase.expectRealtimeLoad)
+            expectLessOrEqual(statistics.getNumDeadlineMisses(), static_cast<int>(phase.numCallbacks * maximumMissRatio),
+                              "too many callbacks took longer than their block");
+       #endif
+    }
+
+    //==============================================================================
+    /** Noise bursts over a swept sine, with peaks up to 0 dBFS when limiting, or up
+        to +12 dBFS otherwise. The sidechain channels get an independent signal.
+    */
+    static void fillInput(juce::Random& random, juce::AudioBuffer<float>& block, double startTime, bool limiting)
+    {
+        const auto peak = limiting ? 1.0f : 4.0f;
+        const auto burst = random.nextInt(4) == 0;
+
+        for (int channel = 0; channel < block.getNumChannels(); ++channel)
+        {
+            auto* samples = block.getWritePointer(channel);
+            const auto frequency = 40.0 + 4000.0 * (0.5 + 0.5 * std::sin(0.1 * startTime + channel));
+
+            for (int i = 0; i < block.getNumSamples(); ++i)
+            {
+                const auto time = startTime + i / sampleRate;
+                auto x = 0.5f * static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * frequency * time));
+
+                if (burst)
+                    x += 0.5f * (2.0f * random.nextFloat() - 1.0f);
+
+                samples[i] = peak * x;
+            }
+        }
+    }
+
+    static void setParameter(HeuristicLimiterAudioProcessor& processor, const juce::String& id, float value)
+    {
+        for (auto* parameter : processor.getParameters())
+            if (auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter); ranged != nullptr && ranged->paramID == id)
+                ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+    }
+
+    static void setLimitingDefaults(HeuristicLimiterAudioProcessor& processor)
+    {
+        setParameter(processor, "LIMITER", 1.0f);
+        setParameter(processor, "THRESHOLD", -1.0f);
+        setParameter(processor, "GAIN", 0.0f);
+    }
+
+    void automateParameter(juce::Random& random, HeuristicLimiterAudioProcessor& processor, Automation automation)
+    {
+        const auto& parameters = processor.getParameters();
+        auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(parameters[random.nextInt(parameters.size())]);
+
+        if (ranged == nullptr)
+            return;
+
+        if (automation == Automation::limiting)
+        {
+            // レシオは∞のまま、スレッショルドは-12〜-1dB、ゲインは+6dBまで
+            if (ranged->paramID == "RATIO" || ranged->paramID == "LIMITER")
+                return;
+
+            if (ranged->paramID == "THRESHOLD")
+            {
+                setParameter(processor, "THRESHOLD", -12.0f + 11.0f * random.nextFloat());
+                return;
+            }
+
+            if (ranged->paramID == "GAIN")
+            {
+                setParameter(processor, "GAIN", 6.0f * random.nextFloat());
+                return;
+            }
+        }
+
+        ranged->setValueNotifyingHost(random.nextFloat());
+    }
+};
+
+static StressTest stressTest;